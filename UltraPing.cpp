@@ -12,6 +12,15 @@
 // ---------------------------------------------------------------------------
 
 #include <UltraPing.h>
+#include <UltraPingQueue.h>
+#include <UltraPingTrace.h>
+
+
+uint32_t UltraPing::_lengthScale = ULTRAPING_SCALE(1, ULTRAPING_US_ROUNDTRIP_LENGTH);
+uint32_t UltraPing::_mmScale = ULTRAPING_SCALE(ULTRAPING_LENGTH_UNIT_TENTH_MM, 10UL * ULTRAPING_US_ROUNDTRIP_LENGTH);
+uint16_t UltraPing::_roundtripTime = ULTRAPING_US_ROUNDTRIP_LENGTH * 256U;
+void (*UltraPing::_yieldFunc)(void) = NULL;
+unsigned int UltraPing::_yieldBudget = 0;
 
 
 // ---------------------------------------------------------------------------
@@ -27,12 +36,39 @@ UltraPing::UltraPing(uint8_t trigger_pin, uint8_t echo_pin, unsigned int max_dis
 	_echoInput = portInputRegister(digitalPinToPort(echo_pin));         // Get the input port register for the echo pin.
 
 	_triggerMode = (uint8_t *) portModeRegister(digitalPinToPort(trigger_pin)); // Get the port mode register for the trigger pin.
+	#if ULTRAPING_EDGE_ENABLED == true && ULTRAPING_EDGE_ICP1 == false
+		_echoPin = echo_pin; // Pin number is needed for attachInterrupt().
+	#endif
 #else
 	_triggerPin = trigger_pin;
 	_echoPin = echo_pin;
 #endif
 
+	_startDelay = UltraPingAnySensor::start_delay; // Profile that fits every sensor, until set_profile.
+	_deadTime = UltraPingAnySensor::dead_time;
+	_minSeparation = UltraPingAnySensor::min_separation;
+	_activeLow = UltraPingAnySensor::active_low;
+	_latencyMin = 0xFFFF;           // Not calibrated, ping_multi learns them.
+	_latencyMax = 0;
 	set_max_distance(max_distance); // Call function to set the max sensor distance.
+	_roundBudget = 0;               // No limit on ping_multi rounds.
+	_probeCount = 0;
+	_multiReuse = 0;                // Every round measures the first echo.
+	_settleTime = ULTRAPING_PING_MEDIAN_DELAY; // Start safe, learn shorter.
+	multi_rounds = 0;
+#if ULTRAPING_TIMER_ENABLED == true || ULTRAPING_EDGE_ENABLED == true
+	_queue = NULL;
+#endif
+#if ULTRAPING_TRACE_ENABLED == true
+	_trace = NULL;
+#endif
+#if ULTRAPING_HEALTH_ENABLED == true
+	_health = ULTRAPING_HEALTH_OK;
+	_healthFails = 0;
+#endif
+#if ULTRAPING_STATS_ENABLED == true
+	reset_stats();
+#endif
 
 #if (defined (__arm__) && defined (TEENSYDUINO)) || ULTRAPING_DO_BITWISE != true
 	pinMode(echo_pin, INPUT);     // Set echo pin to input (on Teensy 3.x (ARM), pins default to disabled, at least one pinMode() is needed for GPIO mode).
@@ -54,15 +90,7 @@ UltraPing::UltraPing(uint8_t trigger_pin, uint8_t echo_pin, unsigned int max_dis
 // ---------------------------------------------------------------------------
 
 unsigned int UltraPing::ping(unsigned int max_distance) {
-	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
-
-	if (!ping_trigger()) return  ULTRAPING_NO_ECHO; // Trigger a ping, if it returns false, return NO_ECHO to the calling function.
-
-	while (ULTRAPING_ISACTIVE(readEcho())) {                // Wait for the ping echo.
-		if (micros() > _max_time) return ULTRAPING_NO_ECHO; // Stop the loop and return NO_ECHO (false) if we're beyond the set maximum distance.
-	}
-
-	return (micros() - (_max_time - _maxEchoTime) - ULTRAPING_PING_OVERHEAD); // Calculate ping time, include overhead.
+	return ping_traced<UltraPingRuntimePins>(max_distance);
 }
 
 unsigned int UltraPing::ping_threshold(unsigned int threshold_distance, unsigned int max_distance) {
@@ -71,195 +99,349 @@ unsigned int UltraPing::ping_threshold(unsigned int threshold_distance, unsigned
 	return hit[0];
 }
 
+void UltraPing::set_round_budget(uint8_t rounds) {
+	_roundBudget = rounds; // 0 = no limit.
+	ULTRAPING_TRACE(ULTRAPING_TRACE_BUDGET, rounds);
+}
+
+void UltraPing::set_multi_probes(const unsigned int probes[], uint8_t count) {
+	_probes = probes;
+	_probeCount = count;
+}
+
+void UltraPing::set_multi_reuse(uint8_t rounds) {
+	_multiReuse = min(rounds, (uint8_t) ULTRAPING_MULTI_REUSE_MAX);
+}
+
 unsigned int UltraPing::ping_multi(unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance) {
-	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
+	return ping_multi_traced<UltraPingRuntimePins>(hit, maximum_hits, threshold_distance, max_distance);
+}
 
-	unsigned int offset = 0;
-	unsigned int i = 0;
-	while(i < maximum_hits) {
-		if (!ping_trigger()) return 0; // Trigger a ping, if it returns false, return 0 hits (Something wrong)
-		unsigned long first_max_time = _max_time; //The max_time from first ping, is also used later as max for second ping.
-		unsigned long first_start = (_max_time - _maxEchoTime) - ULTRAPING_PING_OVERHEAD;
+// ---------------------------------------------------------------------------
+// ping_multi support functions, shared by ping_multi and ping_multi_timer (not called directly)
+// ---------------------------------------------------------------------------
 
-		while (ULTRAPING_ISACTIVE(readEcho())) {                // Wait for the ping echo.
-			if (micros() > _max_time) return i; // Stop the loop and return hits so far.
-		}
-		unsigned int first_length = micros() - first_start; // Calculate ping time, for first echo.
-
-		if (offset == 0) { //Only first loop
-			if (first_length > threshold_distance * ULTRAPING_US_ROUNDTRIP_LENGTH) {
-				offset = hit[i++] = first_length; //If first echo, above threshold, register as a hit.
-				if(i >= maximum_hits) return i; //If this method is used with maximum_hits == 1, and first_length is beyond threshold
-			} else {
-				offset = threshold_distance * ULTRAPING_US_ROUNDTRIP_LENGTH;
-			}
-		}
-		// #######################################################################################################################################################
-		while (micros() < first_start + offset);//Wait before we start next ping, to let secondary echos from first ping return before first echo from second ping.
-		// #######################################################################################################################################################
+void UltraPing::multi_begin(multi_state &m, unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance) {
+	m.hit = hit;
+	m.maximum_hits = maximum_hits;
+	m.hits = 0;
+	m.offset = 0;
+	m.threshold = convert_us(threshold_distance);
+	m.rounds = multi_rounds = 0;
+	m.latency_min = _latencyMin; // From calibrate(), or learned from the first second ping.
+	m.latency_max = _latencyMax;
+	m.probes = _probes; // Probes are for one call only.
+	m.probe_count = _probeCount;
+	m.probe_next = 0;
+	_probeCount = 0;
+}
 
-		if (!ping_trigger()) return 0; // Trigger a second ping, if it returns false, return 0 hits (Something wrong)
-		while (ULTRAPING_ISACTIVE(readEcho())) {                // Wait for the ping echo.
-			if (micros() > first_max_time) return i; // No more echo within range from first ping, return result
-		}
-		unsigned long second_end_time = micros();
-
-		unsigned long lengthSecond = second_end_time - (_max_time - _maxEchoTime) - ULTRAPING_PING_OVERHEAD;
-		if (lengthSecond < ULTRAPING_THREE_QUARTERS(first_length)) { //If second ping is (significant) shorter than first, it must be an echo from first ping.
-			//New hit!
-			// Calculate ping time from the start of first ping, and register in hit
-			// Push offset (waiting time) forward, so we don't find this hit again.
-			// Increase number of total echos found. (i)
-			offset = hit[i++] = second_end_time - first_start;
+boolean UltraPing::multi_first(multi_state &m) { // First ping measured, returns false if no more hits are wanted.
+	multi_rounds = ++m.rounds;
+	ULTRAPING_STAT(rounds);
+	m.last_end = m.first_length;
+	m.reused = 0;
+	if (m.offset == 0) { //Only first loop
+		m.first_ref = m.first_length;
+		if (m.first_length > m.threshold) {
+			m.offset = m.hit[m.hits++] = m.first_length; //If first echo, above threshold, register as a hit.
+			if(m.hits >= m.maximum_hits) return false; //If this method is used with maximum_hits == 1, and first_length is beyond threshold
 		} else {
-			//Too long, might be first echo from second ping, for next try increase the waiting time for second ping.
-			offset += first_length / 2;
-		}
-		if(i < maximum_hits) { //Only wait, if we are going to do more tries
-			delay(ULTRAPING_PING_MEDIAN_DELAY / 1000); // Wait until all echos ebb away
+			m.offset = m.threshold;
 		}
+		m.offset = multi_next(m, m.offset);
 	}
-	return i; //Maximum number of hits found, return those found so far
+	return multi_room(m); // Don't send a second ping, if it can't find anything.
 }
 
-unsigned long UltraPing::ping_length(unsigned int max_distance) {
-	unsigned long echoTime = ping(max_distance); // Calls the ping method and returns with the ping echo distance in uS.
-	return ULTRAPING_US_2_LENGTH_UNIT(echoTime); // Convert uS to length unit.
+boolean UltraPing::multi_second(multi_state &m, unsigned long second_start, unsigned long second_end_time) { // Second ping measured, returns false if no more hits are wanted.
+	unsigned long lengthSecond = second_end_time - second_start;
+	unsigned long listen = second_start - m.first_start; // Second ping listens for echos from first ping from here.
+	if (listen > m.offset) { // Learn how long after the trigger the sensor starts listening, and how much that varies.
+		unsigned int latency = min(listen - m.offset, 0xFFFFUL);
+		m.latency_min = min(m.latency_min, latency);
+		m.latency_max = max(m.latency_max, latency);
+	}
+	unsigned int window = ULTRAPING_THREE_QUARTERS(m.first_length); // Echos from first ping within this window after listen are told apart from second ping's own.
+	boolean ghost = lengthSecond < window && multi_ghost(m, m.reused, second_end_time - m.first_start, second_end_time - m.first_start);
+	m.last_end = second_end_time - m.first_start;
+	m.second_start[m.reused] = listen;
+	if (lengthSecond < window && !ghost) { //If second ping is (significant) shorter than first, it must be an echo from first ping.
+		//New hit!
+		// Calculate ping time from the start of first ping, and register in hit
+		// Push offset (waiting time) forward, so we don't find this hit again.
+		// Increase number of total echos found. (hits)
+		m.offset = m.hit[m.hits++] = second_end_time - m.first_start;
+		if (_minSeparation > m.latency_min) m.offset += _minSeparation - m.latency_min; // Next round listens from where the sensor can tell another echo apart.
+		ULTRAPING_STAT(probes_accepted);
+	} else {
+		//Too long, might be first echo from second ping. The whole window was free from echos from first ping, so
+		//next try starts listening where this window ended, less a guard for start delay jitter.
+		ULTRAPING_STAT(probes_rejected);
+		unsigned int guard = (m.latency_max - m.latency_min) + ULTRAPING_MULTI_GUARD;
+		if (!ghost) m.offset += window > 2 * guard ? window - guard : m.first_length / 2; // Echo too close for a guarded window, fall back to half steps.
+		else if (m.last_end > (unsigned long) m.offset + 2 * m.latency_max + 2 * guard) m.offset = m.last_end - 2 * m.latency_max - guard; // An earlier second ping's echo, but nothing from the first ping before it. The next round measures the first ping again and listens from a latency before the ghost.
+	}
+	m.offset = multi_next(m, m.offset);
+	if (_roundBudget && m.rounds >= _roundBudget) return false; // Out of rounds.
+	return m.hits < m.maximum_hits && multi_room(m);
 }
 
+unsigned int UltraPing::multi_next(multi_state &m, unsigned int offset) { // Offset for next round: offset to keep searching, or the next probe.
+	offset = max(offset, m.first_length + _deadTime); // The sensor doesn't take a trigger earlier, a round aimed there would listen later than planned.
+	unsigned int window = ULTRAPING_THREE_QUARTERS(m.first_length);
+	while (m.probe_next < m.probe_count && m.probes[m.probe_next] < (unsigned long) offset + m.latency_max + ULTRAPING_MULTI_GUARD)
+		m.probe_next++; // Probe is before next round would start listening, already found or passed.
+	if (m.probe_next == m.probe_count) return offset; // No probes left, search.
+
+	unsigned int probe = m.probes[m.probe_next];
+	unsigned int start = probe > window / 2 + m.latency_max ? probe - window / 2 - m.latency_max : 0; // Listen from half a window before the probe.
+	if (start <= offset) return offset; // Searching covers the probe anyway.
+	uint8_t probes_left = m.probe_count - m.probe_next;
+	if (!_roundBudget || _roundBudget - m.rounds > probes_left) return offset; // Rounds to spare, search the gap before the probe.
+	m.probe_next++;
+	return start; // Skip the gap, go for the probe.
+}
 
-unsigned long UltraPing::ping_median(uint8_t it, unsigned int max_distance) {
-	unsigned int uS[it], last;
-	uint8_t j, i = 0;
-	unsigned long t;
-	uS[0] = ULTRAPING_NO_ECHO;
-
-	while (i < it) {
-		t = micros();                  // Start ping timestamp.
-		last = ping(max_distance);  // Send ping.
-
-		if (last != ULTRAPING_NO_ECHO) {         // Ping in range, include as part of median.
-			if (i > 0) {               // Don't start sort till second ping.
-				for (j = i; j > 0 && uS[j - 1] < last; j--) // Insertion sort loop.
-					uS[j] = uS[j - 1];                      // Shift ping array to correct position for sort insertion.
-			} else j = 0;              // First ping is sort starting point.
-			uS[j] = last;              // Add last ping to array in sorted position.
-			i++;                       // Move to next ping.
-		} else it--;                   // Ping out of range, skip and don't include as part of median.
-
-		if (i < it && micros() - t < ULTRAPING_PING_MEDIAN_DELAY)
-			delay((ULTRAPING_PING_MEDIAN_DELAY + t - micros()) / 1000); // Millisecond delay between pings.
+boolean UltraPing::multi_early(multi_state &m) { // Returns true if first ping in a later round is (significant) shorter than in the first round.
+	if (m.rounds == 0) return false;
+	boolean early = m.first_length < ULTRAPING_THREE_QUARTERS(m.first_ref) && settle_time() < ULTRAPING_PING_MEDIAN_DELAY; // After the longest wait, it's a real echo.
+	settle_learn(early);
+	if (early) ULTRAPING_STAT(early_echos);
+	return early;
+}
+
+boolean UltraPing::multi_reuse(multi_state &m) { // Returns true if the next round sends its second ping from the same first ping.
+	if (m.reused + 1 >= _multiReuse) return false; // Time to measure the first echo again.
+	if (m.offset < m.last_end || m.threshold > m.first_ref || m.probe_count) return false; // Needs to listen before the last ping ended, or echos skipped are unknown and can't be told from new ones.
+	m.offset = max(m.offset, m.last_end + _deadTime); // Not before the sensor takes a trigger again.
+	if (!multi_room(m)) return false;
+	unsigned long listen = (unsigned long) m.offset + m.latency_min;
+	unsigned long until = listen + (m.latency_max - m.latency_min) + ULTRAPING_THREE_QUARTERS(m.first_length); // End of the window it would search.
+	if (multi_ghost(m, m.reused + 1, listen, until < _maxEchoTime ? listen : until)) return false; // It would hear an earlier second ping as soon as it listens, or before the end of a last window that a new first ping searches in one round.
+	m.reused++;
+	multi_rounds = ++m.rounds;
+	ULTRAPING_STAT(rounds);
+	return true;
+}
 
+boolean UltraPing::multi_ghost(multi_state &m, uint8_t pings, unsigned long from, unsigned long until) { // Returns true if an echo of one of the last pings second pings from the same first ping could come back between from and until.
+	unsigned int guard = (m.latency_max - m.latency_min) + ULTRAPING_MULTI_GUARD;
+	unsigned long blind = (unsigned long) m.latency_max + max(_deadTime, _minSeparation) + guard; // Echos this close after a known one were never searched for.
+	for (uint8_t k = 0; k < pings; k++) {
+		for (unsigned int i = 0; i <= m.hits; i++) {
+			unsigned long echo = m.second_start[k] + (unsigned long) (i < m.hits ? m.hit[i] : m.first_ref);
+			if (echo < until + guard && from < echo + blind) return true;
+		}
 	}
-	return (uS[it >> 1]); // Return the ping distance median.
+	return false;
 }
 
-// -------------------------------------------------------------------------------------
-// Input and output methods (Bitwise or normal)
-// All of them are marked inline, so compiler will probably inline them at compile-time.
-// -------------------------------------------------------------------------------------
+boolean UltraPing::multi_room(multi_state &m) { // Returns false if the window left up to max distance can't hold another echo.
+	return (unsigned long) m.offset + m.latency_max + ULTRAPING_MULTI_GUARD < _maxEchoTime; // Second ping would start listening too late.
+}
 
-inline boolean UltraPing::readEcho() {
-	#if ULTRAPING_DO_BITWISE == true
-		return *_echoInput & _echoBit;
-	#else
-		return digitalRead(_echoPin);
-	#endif
+
+unsigned long UltraPing::ping_length(unsigned int max_distance) {
+	unsigned long echoTime = ping(max_distance); // Calls the ping method and returns with the ping echo distance in uS.
+	return ULTRAPING_US_2_LENGTH_UNIT(echoTime, _lengthScale); // Convert uS to length unit.
 }
 
-inline void UltraPing::setTriggerActive() {
-	#if ULTRAPING_DO_BITWISE == true
-		*_triggerOutput |= _triggerBit;    // Set trigger pin high, this tells the sensor to send out a ping.
-	#else
-		digitalWrite(_triggerPin, HIGH);   // Set trigger pin high, this tells the sensor to send out a ping.
-	#endif
+
+unsigned long UltraPing::ping_median(uint8_t it, unsigned int max_distance) {
+	return ping_median_traced<UltraPingRuntimePins>(it, max_distance);
 }
-inline void UltraPing::setTriggerNotActive() {
-	#if ULTRAPING_DO_BITWISE == true
-		*_triggerOutput &= ~_triggerBit;   // Set the trigger pin low.
-	#else
-		digitalWrite(_triggerPin, LOW);    // Set the trigger pin low.
-	#endif
+
+void UltraPing::set_yield(void (*userFunc)(void), unsigned int budget) {
+	_yieldFunc = userFunc; // NULL = just delay.
+	_yieldBudget = budget;
 }
-#if ULTRAPING_ONE_PIN_ENABLED == true
-	inline void UltraPing::onePinSetTriggerMode() {
-		#if ULTRAPING_DO_BITWISE == true
-			*_triggerMode |= _triggerBit;  // Set trigger pin to output.
-		#else
-			pinMode(_triggerPin, OUTPUT); // Set trigger pin to output.
-		#endif
-	}
-	inline void UltraPing::onePinSetEchoMode() {
-		#if ULTRAPING_DO_BITWISE == true
-			*_triggerMode &= ~_triggerBit; // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
-		#else
-			pinMode(_triggerPin, INPUT);  // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
-		#endif
-	}
+
+boolean UltraPing::calibrate(UltraPingCalibration *result) {
+	ULTRAPING_STAT_BUSY();
+#if ULTRAPING_TRACE_ENABLED == true
+	UltraPingTraceBase *trace = _trace; // Probe pings aren't calls a replay knows, keep them out of the trace.
+	_trace = NULL;
 #endif
+	UltraPingCalibration c;
+	boolean done = calibrate_probe(c);
+#if ULTRAPING_TRACE_ENABLED == true
+	_trace = trace;
+#endif
+	if (!done) return false;
+	_latencyMin = c.latency_min;
+	_latencyMax = c.latency_max;
+	set_profile(min(2UL * c.latency_max, 0xFFFFUL), c.dead_time, c.min_separation, _activeLow);
+	if (result) *result = c;
+	return true;
+}
+
+unsigned int UltraPing::settle_time() {
+	unsigned long floor = min(2UL * _maxEchoTime, (unsigned long) ULTRAPING_PING_MEDIAN_DELAY); // Secondary echos from within max distance return within twice the max echo time.
+	return max((unsigned long) _settleTime, floor);
+}
 
 // ---------------------------------------------------------------------------
 // Standard and timer interrupt ping method support functions (not called directly)
 // ---------------------------------------------------------------------------
 
-boolean UltraPing::ping_trigger() {
-	#if ULTRAPING_ONE_PIN_ENABLED == true
-		onePinSetTriggerMode();
-	#endif
+void UltraPing::settle(unsigned long since) { // Wait until echos from the ping sent at since have ebbed away.
+	unsigned long wait = settle_time(), passed;
+	while (_yieldFunc && micros() - since + _yieldBudget < wait) { // Give the wait to the sketch while it can't overrun.
+		ULTRAPING_STAT(yields);
+		_yieldFunc();
+	}
+	passed = micros() - since;
+	if (passed >= wait) return;
+	wait -= passed;
+	delay(wait / 1000);              // Millisecond delay, lets the board do other things.
+	delayMicroseconds(wait % 1000);
+}
 
-	setTriggerNotActive();             // Should already be low, but this will make sure it is.
-	delayMicroseconds(4);              // Wait for pin to go low.
-	setTriggerActive();                // Set trigger pin high, this tells the sensor to send out a ping.
-	delayMicroseconds(10);             // Wait long enough for the sensor to realize the trigger pin is high. Sensor specs say to wait 10uS.
-	setTriggerNotActive();             // Set trigger pin back to low.
+void UltraPing::settle_learn(boolean early) { // Learn how long echos last, from whether a ping came back early.
+#if ULTRAPING_SETTLE_ADAPTIVE == true
+	if (early) _settleTime = min(2UL * settle_time(), (unsigned long) ULTRAPING_PING_MEDIAN_DELAY); // Echos from the last ping came back, back off.
+	else _settleTime = settle_time() - settle_time() / ULTRAPING_SETTLE_CREEP;                     // Try a little shorter next time.
+#else
+	(void) early; // Fixed settle time, nothing to learn.
+#endif
+}
 
-	#if ULTRAPING_ONE_PIN_ENABLED == true
-		onePinSetEchoMode(); // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
-	#endif
+boolean UltraPing::ping_trigger() {
+	return ping_trigger_pins<UltraPingRuntimePins>();
+}
 
-	if (ULTRAPING_ISACTIVE(readEcho())) return false;               // Previous ping hasn't finished, abort.
-	_max_time = micros() + _maxEchoTime + ULTRAPING_MAX_SENSOR_DELAY; // Maximum time we'll wait for ping to start (most sensors are <450uS, the SRF06 can take up to 34,300uS!)
-	while (ULTRAPING_ISNOTACTIVE(readEcho())) {                       // Wait for ping to start.
-		if (micros() > _max_time) return false;             // Took too long to start, abort.
-	}
 
-	_max_time = micros() + _maxEchoTime; // Ping started, set the time-out.
-	return true;                         // Ping started successfully.
+boolean UltraPing::ping_send() { // Send trigger pulse without waiting for the ping to start.
+	return ping_send_pins<UltraPingRuntimePins>();
 }
 
 
 void UltraPing::set_max_distance(unsigned int max_distance) {
 #if ULTRAPING_ROUNDING_ENABLED == false
-	_maxEchoTime = min(max_distance + 1, (unsigned int) ULTRAPING_MAX_SENSOR_DISTANCE + 1) * ULTRAPING_US_ROUNDTRIP_LENGTH; // Calculate the maximum distance in uS (no rounding).
+	_maxEchoTime = convert_us(min(max_distance + 1, (unsigned int) ULTRAPING_MAX_SENSOR_DISTANCE + 1)); // Calculate the maximum distance in uS (no rounding).
 #else
-	_maxEchoTime = min(max_distance, (unsigned int) ULTRAPING_MAX_SENSOR_DISTANCE) * ULTRAPING_US_ROUNDTRIP_LENGTH + (ULTRAPING_US_ROUNDTRIP_LENGTH / 2); // Calculate the maximum distance in uS.
+	_maxEchoTime = convert_us(min(max_distance, (unsigned int) ULTRAPING_MAX_SENSOR_DISTANCE)) + (_roundtripTime >> 9); // Calculate the maximum distance in uS.
 #endif
+	set_limits();
+}
+
+
+void UltraPing::set_profile(unsigned int start_delay, unsigned int dead_time, unsigned int min_separation, boolean active_low) {
+	_startDelay = start_delay;
+	_deadTime = dead_time;
+	_minSeparation = min_separation;
+	_activeLow = active_low;
+	set_limits();
+}
+
+
+void UltraPing::set_limits() { // Waits in ticks, from the max echo time and the profile.
+	_maxEchoTicks = min((unsigned long) _maxEchoTime * ULTRAPING_TICKS_PER_US, ULTRAPING_TICKS_LIMIT);
+	unsigned long startLimit = start_wait() * ULTRAPING_TICKS_PER_US;
+	_startLimit = startLimit <= ULTRAPING_TICKS_LIMIT ? startLimit : 0; // 16-bit ticks wait at most 32ms, a longer start wait is timed with micros().
+}
+
+
+unsigned long UltraPing::start_wait() { // Longest uS from trigger to ping start.
+#if ULTRAPING_HEALTH_ENABLED == true
+	if (_healthFails >= ULTRAPING_HEALTH_FAILS && !_startDelay) return ULTRAPING_MAX_SENSOR_DELAY; // Quarantined, a probe fails fast.
+#endif
+	return _startDelay ? _startDelay : (unsigned long) _maxEchoTime + ULTRAPING_MAX_SENSOR_DELAY;
+}
+
+
+// ---------------------------------------------------------------------------
+// calibrate support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+boolean UltraPing::calibrate_probe(UltraPingCalibration &c) { // Measure the sensor, false if a ping has no echo.
+	unsigned long sent, start, end, second;
+	c.latency_min = 0xFFFF;
+	c.latency_max = 0;
+	for (uint8_t i = 0; i < ULTRAPING_CALIBRATE_PINGS; i++) { // Trigger latency.
+		if (!calibrate_start(start_wait(), sent, start) || !calibrate_echo(start, end)) return false;
+		c.latency_min = min(c.latency_min, (unsigned int) min(start - sent, 0xFFFFUL));
+		c.latency_max = max(c.latency_max, (unsigned int) min(start - sent, 0xFFFFUL));
+		settle(sent);
+	}
+
+	// Dead time: trigger a second ping wait uS after the echo ends. Doubles wait until the sensor takes it, then halves the gap to the last wait it didn't.
+	unsigned long limit = 2UL * c.latency_max + ULTRAPING_MULTI_GUARD; // A second ping that hasn't started by then wasn't taken.
+	long refused = -1, taken = ULTRAPING_PING_MEDIAN_DELAY, wait = 0;
+	while (taken - refused > ULTRAPING_CALIBRATE_STEP) {
+		if (!calibrate_start(start_wait(), sent, start) || !calibrate_echo(start, end)) return false;
+		while (micros() - end < (unsigned long) wait);
+		if (calibrate_start(limit, sent, second)) {
+			taken = wait;
+			c.min_separation = min(second - end, 0xFFFFUL);
+			if (!calibrate_echo(second, end)) return false;
+		} else refused = wait;
+		settle(sent);
+		if (taken == ULTRAPING_PING_MEDIAN_DELAY) wait = wait ? 2 * wait : ULTRAPING_CALIBRATE_STEP;
+		else wait = (refused + taken) / 2;
+		if (wait >= ULTRAPING_PING_MEDIAN_DELAY) return false; // Never took a second trigger.
+	}
+	c.dead_time = taken;
+	return true;
+}
+
+boolean UltraPing::calibrate_start(unsigned long wait, unsigned long &sent, unsigned long &start) { // Trigger a ping, false if it hasn't started wait uS after the trigger.
+	sent = micros();
+	if (!ping_send()) return false;
+	while (!echoActive()) if (micros() - sent > wait) return false;
+	start = micros();
+	return true;
 }
 
+boolean UltraPing::calibrate_echo(unsigned long start, unsigned long &end) { // Wait for the echo of the ping started at start, false if none within max distance.
+	while (echoActive()) if (micros() - start > _maxEchoTime) return false;
+	end = micros();
+	return true;
+}
+
+
+unsigned long UltraPing::convert_us(unsigned int length) { // Round-trip time in uS for length.
+	return ((uint32_t) length * _roundtripTime) >> 8;
+}
 
-#if ULTRAPING_TIMER_ENABLED == true && ULTRAPING_DO_BITWISE == true
+
+#if ULTRAPING_TIMER_ENABLED == true && (ULTRAPING_DO_BITWISE == true || ULTRAPING_INTERVAL_TIMER == true)
 
 // ---------------------------------------------------------------------------
-// Timer interrupt ping methods (won't work with non-AVR, ATmega128 and all ATtiny microcontrollers)
+// Timer interrupt ping methods (won't work with non-AVR, ATmega128 and all ATtiny microcontrollers, except Teensy 3.x and the simulator)
 // ---------------------------------------------------------------------------
 
-void UltraPing::ping_timer(void (*userFunc)(void), unsigned int max_distance) {
+// ping_multi_timer states
+#define ULTRAPING_MULTI_IDLE         0 // No measurement running.
+#define ULTRAPING_MULTI_FIRST_START  1 // First ping triggered, waiting for it to start.
+#define ULTRAPING_MULTI_FIRST_ECHO   2 // Waiting for echo of first ping.
+#define ULTRAPING_MULTI_OFFSET_WAIT  3 // Waiting for offset before second ping.
+#define ULTRAPING_MULTI_SECOND_START 4 // Second ping triggered, waiting for it to start.
+#define ULTRAPING_MULTI_SECOND_ECHO  5 // Waiting for echo to second ping.
+#define ULTRAPING_MULTI_SETTLE       6 // Waiting for echos to ebb away before next round.
+
+boolean UltraPing::ping_timer(void (*userFunc)(void), unsigned int max_distance) {
 	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
 
-	if (!ping_trigger()) return;         // Trigger a ping, if it returns false, return without starting the echo timer.
-	timer_us(ULTRAPING_ECHO_TIMER_FREQ, userFunc); // Set ping echo timer check every ECHO_TIMER_FREQ uS.
+	if (!timer_free(this)) return false;  // No timer slot for the echo check, don't ping.
+	if (!ping_trigger()) return false;    // Trigger a ping, if it returns false, return without starting the echo timer.
+	return timer_attach(this, ULTRAPING_ECHO_TIMER_FREQ, userFunc); // Set ping echo timer check every ECHO_TIMER_FREQ uS.
 }
 
 
 boolean UltraPing::check_timer() {
 	if (micros() > _max_time) { // Outside the time-out limit.
-		timer_stop();           // Disable timer interrupt
+		ULTRAPING_STAT(echo_timeouts);
+		timer_detach(this);     // Stop checking this sensor
+		if (_queue) publish(ping_result, ULTRAPING_NO_ECHO, 0); // Queue the time-out, ping_result keeps the last echo as before.
 		return false;           // Cancel ping timer.
 	}
 
-	if (ULTRAPING_ISACTIVE(readEcho())) {    // Ping echo received.
-		timer_stop();                // Disable timer interrupt
-		ping_result = (micros() - (_max_time - _maxEchoTime) - ULTRAPING_PING_TIMER_OVERHEAD); // Calculate ping time including overhead.
+	if (!echoActive()) { // Ping echo received.
+		timer_detach(this);          // Stop checking this sensor
+		unsigned long echoTime = (micros() - (_max_time - _maxEchoTime) - ULTRAPING_PING_TIMER_OVERHEAD); // Calculate ping time including overhead.
+		publish(echoTime, echoTime, 1);
 		return true;                 // Return ping echo true.
 	}
 
@@ -269,60 +451,40 @@ boolean UltraPing::check_timer() {
 
 // ---------------------------------------------------------------------------
 // Timer2/Timer4 interrupt methods (can be used for non-ultrasonic needs)
+// One timer interrupt serves everything: ping_timer and ping_multi_timer of
+// every sensor, UltraPingArray, timer_us and timer_ms each get a slot, and
+// the interrupt calls each slot's function when its period has passed. The
+// interrupt runs at the shortest period in use (max 1000uS), and only loops
+// over slots up to the last one in use.
 // ---------------------------------------------------------------------------
 
 // Variables used for timer functions
-void (*intFunc)();
-void (*intFunc2)();
-unsigned long _ms_cnt_reset;
-volatile unsigned long _ms_cnt;
-#if defined(__arm__) && defined(TEENSYDUINO)
+UltraPing::timer_slot UltraPing::_timerSlot[ULTRAPING_TIMER_SLOTS];
+volatile uint8_t UltraPing::_timerSlots = 0;
+unsigned int UltraPing::_timerTick = 0;
+static uint8_t timerUsOwner, timerMsOwner; // Only the addresses are used, they own the timer_us and timer_ms slots.
+#if ULTRAPING_INTERVAL_TIMER == true
 	IntervalTimer itimer;
 #endif
 
 
 void UltraPing::timer_us(unsigned int frequency, void (*userFunc)(void)) {
-	intFunc = userFunc; // User's function to call when there's a timer event.
-	timer_setup();      // Configure the timer interrupt.
-
-#if defined (__AVR_ATmega32U4__) // Use Timer4 for ATmega32U4 (Teensy/Leonardo).
-	OCR4C = min((frequency>>2) - 1, 255); // Every count is 4uS, so divide by 4 (bitwise shift right 2) subtract one, then make sure we don't go over 255 limit.
-	TIMSK4 = (1<<TOIE4);                  // Enable Timer4 interrupt.
-#elif defined (__arm__) && defined (TEENSYDUINO) // Timer for Teensy 3.x
-	itimer.begin(userFunc, frequency);           // Really simple on the Teensy 3.x, calls userFunc every 'frequency' uS.
-#else
-	OCR2A = min((frequency>>2) - 1, 255); // Every count is 4uS, so divide by 4 (bitwise shift right 2) subtract one, then make sure we don't go over 255 limit.
-	TIMSK2 |= (1<<OCIE2A);                // Enable Timer2 interrupt.
-#endif
+	timer_attach(&timerUsOwner, frequency, userFunc); // Call userFunc every frequency uS, replaces the previous timer_us.
 }
 
 
 void UltraPing::timer_ms(unsigned long frequency, void (*userFunc)(void)) {
-	intFunc = UltraPing::timer_ms_cntdwn;  // Timer events are sent here once every ms till user's frequency is reached.
-	intFunc2 = userFunc;                 // User's function to call when user's frequency is reached.
-	_ms_cnt = _ms_cnt_reset = frequency; // Current ms counter and reset value.
-	timer_setup();                       // Configure the timer interrupt.
-
-#if defined (__AVR_ATmega32U4__) // Use Timer4 for ATmega32U4 (Teensy/Leonardo).
-	OCR4C = 249;           // Every count is 4uS, so 1ms = 250 counts - 1.
-	TIMSK4 = (1<<TOIE4);   // Enable Timer4 interrupt.
-#elif defined (__arm__) && defined (TEENSYDUINO)  // Timer for Teensy 3.x
-	itimer.begin(UltraPing::timer_ms_cntdwn, 1000); // Set timer to 1ms (1000 uS).
-#else
-	OCR2A = 249;           // Every count is 4uS, so 1ms = 250 counts - 1.
-	TIMSK2 |= (1<<OCIE2A); // Enable Timer2 interrupt.
-#endif
+	timer_attach(&timerMsOwner, frequency * 1000, userFunc); // Call userFunc every frequency ms, replaces the previous timer_ms.
 }
 
 
-void UltraPing::timer_stop() { // Disable timer interrupt.
-#if defined (__AVR_ATmega32U4__) // Use Timer4 for ATmega32U4 (Teensy/Leonardo).
-	TIMSK4 = 0;
-#elif defined (__arm__) && defined (TEENSYDUINO) // Timer for Teensy 3.x
-	itimer.end();
-#else
-	TIMSK2 &= ~(1<<OCIE2A);
-#endif
+void UltraPing::timer_stop() { // Stop everything on the timer, and the timer interrupt.
+	ULTRAPING_ATOMIC_BEGIN();
+	for (uint8_t i = 0; i < ULTRAPING_TIMER_SLOTS; i++) _timerSlot[i].func = NULL;
+	_timerSlots = 0;
+	_multiTimerState = ULTRAPING_MULTI_IDLE; // An abandoned ping_multi_timer doesn't block the next one.
+	timer_start();
+	ULTRAPING_ATOMIC_END();
 }
 
 
@@ -330,61 +492,509 @@ void UltraPing::timer_stop() { // Disable timer interrupt.
 // Timer2/Timer4 interrupt method support functions (not called directly)
 // ---------------------------------------------------------------------------
 
-void UltraPing::timer_setup() {
+boolean UltraPing::timer_attach(const void *owner, unsigned long period, void (*func)(void)) { // Call func every period uS, in owner's slot. False if all slots are taken.
+	boolean attached = false;
+	ULTRAPING_ATOMIC_BEGIN();
+	uint8_t free = ULTRAPING_TIMER_SLOTS;
+	for (uint8_t i = 0; i < ULTRAPING_TIMER_SLOTS; i++) {
+		if (_timerSlot[i].func && _timerSlot[i].owner == owner) { // Owner already has a slot, reuse it.
+			free = i;
+			break;
+		}
+		if (!_timerSlot[i].func && free == ULTRAPING_TIMER_SLOTS) free = i;
+	}
+	if (free < ULTRAPING_TIMER_SLOTS) {
+		timer_slot &t = _timerSlot[free];
+		t.owner = owner;
+		t.period = period ? period : 1;
+		t.remaining = t.period;
+		t.func = func;
+		if (free >= _timerSlots) _timerSlots = free + 1;
+		timer_start();
+		attached = true;
+	}
+	ULTRAPING_ATOMIC_END();
+	return attached;
+}
+
+
+boolean UltraPing::timer_free(const void *owner) { // True if owner has a slot, or a slot is free. Slots are only taken from loop(), so timer_attach gets it.
+	for (uint8_t i = 0; i < ULTRAPING_TIMER_SLOTS; i++)
+		if (!_timerSlot[i].func || _timerSlot[i].owner == owner) return true;
+	return false;
+}
+
+
+void UltraPing::timer_period(const void *owner, unsigned long period) { // Change the period of owner's slot, counting from now.
+	ULTRAPING_ATOMIC_BEGIN();
+	for (uint8_t i = 0; i < _timerSlots; i++) {
+		timer_slot &t = _timerSlot[i];
+		if (!t.func || t.owner != owner) continue;
+		t.period = t.remaining = period;
+		timer_start();
+		break;
+	}
+	ULTRAPING_ATOMIC_END();
+}
+
+
+void UltraPing::timer_detach(const void *owner) { // Free owner's slot, the timer interrupt stops when no slot is left.
+	ULTRAPING_ATOMIC_BEGIN();
+	for (uint8_t i = 0; i < _timerSlots; i++)
+		if (_timerSlot[i].owner == owner) _timerSlot[i].func = NULL;
+	while (_timerSlots && !_timerSlot[_timerSlots - 1].func) _timerSlots--;
+	timer_start();
+	ULTRAPING_ATOMIC_END();
+}
+
+
+void UltraPing::timer_start() { // Run the timer interrupt at the shortest period in use, or stop it. Interrupts must be off.
+	unsigned long tick = ULTRAPING_TIMER_MAX_TICK;
+	for (uint8_t i = 0; i < _timerSlots; i++)
+		if (_timerSlot[i].func && _timerSlot[i].period < tick) tick = _timerSlot[i].period;
+	if (!_timerSlots) tick = 0;
+#if ULTRAPING_INTERVAL_TIMER == false
+	else tick = max(tick & ~3UL, 4UL); // Every count is 4uS.
+#endif
+	if (tick == _timerTick) return; // Already running at that period, keep its phase.
+	_timerTick = tick;
+
 #if defined (__AVR_ATmega32U4__) // Use Timer4 for ATmega32U4 (Teensy/Leonardo).
-	timer_stop(); // Disable Timer4 interrupt.
+	TIMSK4 = 0;   // Disable Timer4 interrupt.
+	if (!tick) return;
 	TCCR4A = TCCR4C = TCCR4D = TCCR4E = 0;
 	TCCR4B = (1<<CS42) | (1<<CS41) | (1<<CS40) | (1<<PSR4); // Set Timer4 prescaler to 64 (4uS/count, 4uS-1020uS range).
 	TIFR4 = (1<<TOV4);
 	TCNT4 = 0;    // Reset Timer4 counter.
-#elif defined (__AVR_ATmega8__) || defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__) || defined (__AVR_ATmega8535__) // Alternate timer commands for certain microcontrollers.
-	timer_stop();                 // Disable Timer2 interrupt.
+	OCR4C = (tick>>2) - 1; // Every count is 4uS, so divide by 4 (bitwise shift right 2) subtract one.
+	TIMSK4 = (1<<TOIE4);   // Enable Timer4 interrupt.
+#elif ULTRAPING_INTERVAL_TIMER == true // Timer for Teensy 3.x and the simulator
+	itimer.end();
+	if (tick) itimer.begin(timer_dispatch, tick); // Really simple on the Teensy 3.x, calls timer_dispatch every 'tick' uS.
+#else
+	TIMSK2 &= ~(1<<OCIE2A);       // Disable Timer2 interrupt.
+	if (!tick) return;
 	ASSR &= ~(1<<AS2);            // Set clock, not pin.
-	TCCR2 = (1<<WGM21 | 1<<CS22); // Set Timer2 to CTC mode, prescaler to 64 (4uS/count, 4uS-1020uS range).
+	#if defined (__AVR_ATmega8__) || defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__) || defined (__AVR_ATmega8535__) // Alternate timer commands for certain microcontrollers.
+		TCCR2 = (1<<WGM21 | 1<<CS22); // Set Timer2 to CTC mode, prescaler to 64 (4uS/count, 4uS-1020uS range).
+	#else
+		TCCR2A = (1<<WGM21);      // Set Timer2 to CTC mode.
+		TCCR2B = (1<<CS22);       // Set Timer2 prescaler to 64 (4uS/count, 4uS-1020uS range).
+	#endif
 	TCNT2 = 0;                    // Reset Timer2 counter.
-#elif defined (__arm__) && defined (TEENSYDUINO)
-	timer_stop(); // Stop the timer.
-#else
-	timer_stop();        // Disable Timer2 interrupt.
-	ASSR &= ~(1<<AS2);   // Set clock, not pin.
-	TCCR2A = (1<<WGM21); // Set Timer2 to CTC mode.
-	TCCR2B = (1<<CS22);  // Set Timer2 prescaler to 64 (4uS/count, 4uS-1020uS range).
-	TCNT2 = 0;           // Reset Timer2 counter.
+	OCR2A = (tick>>2) - 1;        // Every count is 4uS, so divide by 4 (bitwise shift right 2) subtract one.
+	TIMSK2 |= (1<<OCIE2A);        // Enable Timer2 interrupt.
 #endif
 }
 
 
-void UltraPing::timer_ms_cntdwn() {
-	if (!_ms_cnt--) {            // Count down till we reach zero.
-		intFunc2();              // Scheduled time reached, run the main timer event function.
-		_ms_cnt = _ms_cnt_reset; // Reset the ms timer.
+void UltraPing::timer_dispatch() { // The timer interrupt, call every slot whose period has passed.
+	long tick = _timerTick;
+	for (uint8_t i = 0; i < _timerSlots; i++) { // Functions may attach and detach slots, _timerSlots is read again every time.
+		timer_slot &t = _timerSlot[i];
+		if (!t.func || (t.remaining -= tick) > 0) continue;
+		t.remaining += t.period;               // Carry the rest over, so periods that aren't a multiple of the tick are right on average.
+		if (t.remaining <= 0) t.remaining = t.period;
+		t.func();
 	}
 }
 
 #if defined (__AVR_ATmega32U4__) // Use Timer4 for ATmega32U4 (Teensy/Leonardo).
 ISR(TIMER4_OVF_vect) {
-	intFunc(); // Call wrapped function.
+	UltraPing::timer_dispatch();
 }
 #elif defined (__AVR_ATmega8__) || defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__) || defined (__AVR_ATmega8535__) // Alternate timer commands for certain microcontrollers.
 ISR(TIMER2_COMP_vect) {
-	intFunc(); // Call wrapped function.
+	UltraPing::timer_dispatch();
 }
-#elif defined (__arm__)
+#elif ULTRAPING_INTERVAL_TIMER == true
 // Do nothing...
 #else
 ISR(TIMER2_COMPA_vect) {
-	intFunc(); // Call wrapped function.
+	UltraPing::timer_dispatch();
 }
 #endif
 
 
+// ---------------------------------------------------------------------------
+// Timer interrupt ping_multi methods
+// Same measurement as ping_multi, but as a state machine advanced by
+// check_multi_timer() from the timer interrupt, so the CPU is free during
+// echo waits, offset waits and settle delays.
+// ---------------------------------------------------------------------------
+
+UltraPing::multi_state UltraPing::_multiTimer;
+volatile uint8_t UltraPing::_multiTimerState = ULTRAPING_MULTI_IDLE;
+
+
+boolean UltraPing::ping_multi_timer(unsigned int hits[], unsigned int maximum_hits, void (*userFunc)(void), unsigned int threshold_distance, unsigned int max_distance) {
+	if (!maximum_hits || _multiTimerState != ULTRAPING_MULTI_IDLE || !timer_free(this)) return false; // Another ping_multi_timer running or no timer slot, leave hits and state alone.
+	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
+
+	if (!ping_send()) return false; // Sensor busy, return without starting the timer.
+	multi_begin(_multiTimer, hits, maximum_hits, threshold_distance);
+	ping_result = 0;
+	_multiTimerState = ULTRAPING_MULTI_FIRST_START;
+	if (timer_attach(this, ULTRAPING_ECHO_TIMER_FREQ, userFunc)) return true; // Advance the measurement every ECHO_TIMER_FREQ uS.
+	_multiTimerState = ULTRAPING_MULTI_IDLE; // No free timer slot.
+	return false;
+}
+
+
+boolean UltraPing::check_multi_timer() {
+	multi_state &m = _multiTimer;
+	unsigned long now = micros();
+
+	switch (_multiTimerState) {
+		case ULTRAPING_MULTI_FIRST_START:
+			if (ping_started()) {
+				m.first_max_time = _max_time; //The max_time from first ping, is also used later as max for second ping.
+				m.first_start = (_max_time - _maxEchoTime) - ULTRAPING_PING_TIMER_OVERHEAD;
+				_multiTimerState = ULTRAPING_MULTI_FIRST_ECHO;
+			} else if (now > _max_time) { // Took too long to start (Something wrong)
+				ULTRAPING_STAT(start_timeouts);
+				return multi_timer_done(0);
+			}
+			break;
+		case ULTRAPING_MULTI_FIRST_ECHO:
+			if (!echoActive()) {
+				m.first_length = micros() - m.first_start; // Calculate ping time, for first echo.
+				if (multi_early(m)) { // Echo left from last round, wait longer and redo the round.
+					m.settle_time = m.first_start + settle_time();
+					_multiTimerState = ULTRAPING_MULTI_SETTLE;
+					timer_period(this, ULTRAPING_SETTLE_TIMER_FREQ);
+					break;
+				}
+				if (!multi_first(m)) return multi_timer_done(m.hits);
+				_multiTimerState = ULTRAPING_MULTI_OFFSET_WAIT;
+			} else if (now > _max_time) { // No echo, return hits so far.
+				ULTRAPING_STAT(echo_timeouts);
+				return multi_timer_done(m.hits);
+			}
+			break;
+		case ULTRAPING_MULTI_OFFSET_WAIT:
+			if (now < m.first_start + max(m.offset, m.first_length + _deadTime)) break; // Let secondary echos from first ping return before first echo from second ping, and the sensor take a trigger again.
+			if (!ping_send()) return multi_timer_done(0);
+			_multiTimerState = ULTRAPING_MULTI_SECOND_START;
+			break;
+		case ULTRAPING_MULTI_SECOND_START:
+			if (ping_started()) _multiTimerState = ULTRAPING_MULTI_SECOND_ECHO;
+			else if (now > _max_time) {
+				ULTRAPING_STAT(start_timeouts);
+				return multi_timer_done(0);
+			}
+			break;
+		case ULTRAPING_MULTI_SECOND_ECHO:
+			if (!echoActive()) {
+				unsigned long second_start = (_max_time - _maxEchoTime) - ULTRAPING_PING_TIMER_OVERHEAD;
+				if (!multi_second(m, second_start, micros())) return multi_timer_done(m.hits);
+				m.settle_time = second_start + settle_time();
+				_multiTimerState = ULTRAPING_MULTI_SETTLE;
+				timer_period(this, ULTRAPING_SETTLE_TIMER_FREQ); // Nothing to catch while echos ebb away, check less often.
+			} else if (now > m.first_max_time) { // No more echo within range from first ping.
+				ULTRAPING_STAT(echo_timeouts);
+				return multi_timer_done(m.hits);
+			}
+			break;
+		case ULTRAPING_MULTI_SETTLE:
+			if (now < m.settle_time) break;
+			if (!ping_send()) return multi_timer_done(0);
+			_multiTimerState = ULTRAPING_MULTI_FIRST_START;
+			timer_period(this, ULTRAPING_ECHO_TIMER_FREQ);
+			break;
+	}
+	return false; // Measurement not done yet.
+}
+
+
+boolean UltraPing::multi_timer_done(unsigned int hits) {
+	timer_detach(this);                    // Stop advancing the measurement
+	_multiTimerState = ULTRAPING_MULTI_IDLE;
+	publish(hits, hits ? _multiTimer.hit[0] : ULTRAPING_NO_ECHO, hits); // Number of hits found.
+	return true;
+}
+
+
+#endif
+
+
+#if ULTRAPING_EDGE_ENABLED == true
+
+// ---------------------------------------------------------------------------
+// Edge interrupt ping method
+// The echo is timed with one interrupt on each edge of the echo pin, with
+// attachInterrupt() and micros(), or with Timer1 input capture (EDGE_ICP1).
+// Only one ping_edge at a time.
+// ---------------------------------------------------------------------------
+
+// ping_edge states
+#define ULTRAPING_EDGE_IDLE  0 // No ping_edge running.
+#define ULTRAPING_EDGE_START 1 // Trigger sent, waiting for ping to start.
+#define ULTRAPING_EDGE_ECHO  2 // Ping started, waiting for echo.
+#define ULTRAPING_EDGE_DONE  3 // Echo received (or out of range), result in ping_result.
+
+UltraPing * volatile UltraPing::_edgeSonar = NULL;
+void (*UltraPing::_edgeFunc)(void);
+volatile unsigned long UltraPing::_edgeStart;
+volatile uint8_t UltraPing::_edgeState = ULTRAPING_EDGE_IDLE;
+#if ULTRAPING_EDGE_ICP1 == true
+volatile unsigned long UltraPing::_edgeStartUs; // micros() at the start edge, counts the Timer1 wraps during the echo.
+#endif
+
+
+boolean UltraPing::ping_edge(void (*userFunc)(void), unsigned int max_distance) {
+	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
+
+	edge_stop();                       // Make sure previous ping_edge is canceled (insurance).
+	ping_result = ULTRAPING_NO_ECHO;
+	_edgeState = ULTRAPING_EDGE_IDLE;
+	if (!ping_send()) return false;    // Previous ping hasn't finished, return without arming the interrupt.
+
+	_edgeSonar = this;
+	_edgeFunc = userFunc;
+	_edgeState = ULTRAPING_EDGE_START;
+#if ULTRAPING_EDGE_ICP1 == true
+	TIMSK1 = 0;                                         // Disable Timer1 interrupts.
+	TCCR1A = 0;                                         // Normal mode, free running.
+	TCCR1B = ULTRAPING_ICP1_START_EDGE | (1<<CS11);     // Capture on ping start edge, prescaler 8.
+	TIFR1 = (1<<ICF1);                                  // Clear pending capture.
+	TIMSK1 = (1<<ICIE1);                                // Enable input capture interrupt.
+#else
+	int interrupt = digitalPinToInterrupt(_echoPin);
+	if (interrupt == NOT_AN_INTERRUPT) {                 // Echo pin can't interrupt.
+		_edgeState = ULTRAPING_EDGE_IDLE;
+		return false;
+	}
+	attachInterrupt(interrupt, edge_isr, CHANGE);       // Interrupt on both edges of the echo.
 #endif
+	return true;
+}
+
+
+boolean UltraPing::check_edge() {
+	if (_edgeSonar == this && _edgeState != ULTRAPING_EDGE_DONE && micros() > _max_time) { // Ping never started or returned.
+		if (_edgeState == ULTRAPING_EDGE_ECHO) ULTRAPING_STAT(echo_timeouts);
+		else ULTRAPING_STAT(start_timeouts);
+		edge_stop();
+		_edgeState = ULTRAPING_EDGE_DONE;
+	}
+	return _edgeSonar == this && _edgeState == ULTRAPING_EDGE_DONE && ping_result != ULTRAPING_NO_ECHO;
+}
+
+
+// ---------------------------------------------------------------------------
+// Edge interrupt method support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+void UltraPing::edge_isr() {
+#if ULTRAPING_EDGE_ICP1 == true
+	uint16_t time = ICR1;                                 // Timer1 count at the edge.
+	UltraPing *sonar = _edgeSonar;
+	if (!sonar) return;
+	if ((TCCR1B & (1<<ICES1)) == ULTRAPING_ICP1_START_EDGE) { // Ping started.
+		_edgeStart = time;
+		_edgeStartUs = micros();
+		sonar->_max_time = _edgeStartUs + sonar->_maxEchoTime; // Ping started, check_edge times out the echo from here.
+		_edgeState = ULTRAPING_EDGE_ECHO;
+		TCCR1B ^= (1<<ICES1);                             // Capture the other edge next.
+		TIFR1 = (1<<ICF1);                                // Changing edge may set the flag, clear it.
+	} else if (_edgeState == ULTRAPING_EDGE_ECHO) {
+		unsigned long echoTime = (uint16_t) (time - (uint16_t) _edgeStart) / ULTRAPING_ICP1_COUNTS_PER_US; // 16-bit arithmetic, wraps every ICP1_WRAP_US.
+		long missed = (long) (micros() - _edgeStartUs - echoTime); // micros() since the start edge is coarse, but tells how many times Timer1 wrapped.
+		echoTime += (missed + ULTRAPING_ICP1_WRAP_US / 2) / ULTRAPING_ICP1_WRAP_US * ULTRAPING_ICP1_WRAP_US; // A no echo time-out (38ms on the HC-SR04) is then beyond max distance.
+		sonar->edge_done(echoTime);
+	}
+#else
+	unsigned long time = micros();                        // Timestamp first.
+	UltraPing *sonar = _edgeSonar;
+	if (!sonar) return;
+	if (sonar->echoActive()) {          // Ping started.
+		_edgeStart = time;
+		sonar->_max_time = time + sonar->_maxEchoTime; // check_edge times out the echo from here, not from the trigger.
+		_edgeState = ULTRAPING_EDGE_ECHO;
+	} else if (_edgeState == ULTRAPING_EDGE_ECHO) {
+		sonar->edge_done(time - _edgeStart);
+	}
+#endif
+}
+
+
+void UltraPing::edge_done(unsigned long echoTime) {
+	edge_stop();
+	if (echoTime > _maxEchoTime) echoTime = ULTRAPING_NO_ECHO; // Beyond the set maximum distance is no echo.
+	if (echoTime == ULTRAPING_NO_ECHO) ULTRAPING_STAT(echo_timeouts);
+	publish(echoTime, echoTime, echoTime != ULTRAPING_NO_ECHO);
+	_edgeState = ULTRAPING_EDGE_DONE;
+	_edgeFunc();
+}
+
 
+void UltraPing::edge_stop() { // Disable echo edge interrupt.
+#if ULTRAPING_EDGE_ICP1 == true
+	TIMSK1 &= ~(1<<ICIE1);
+#else
+	if (_edgeSonar) detachInterrupt(digitalPinToInterrupt(_edgeSonar->_echoPin));
+#endif
+}
+
+#if ULTRAPING_EDGE_ICP1 == true
+ISR(TIMER1_CAPT_vect) {
+	UltraPing::edge_isr();
+}
+#endif
+
+#endif
+
+
+#if ULTRAPING_TIMER_ENABLED == true || ULTRAPING_EDGE_ENABLED == true
 
 // ---------------------------------------------------------------------------
-// Conversion method (rounds result to nearest cm or inch).
+// Result queue, see UltraPingQueue.h
+// ---------------------------------------------------------------------------
+
+void UltraPing::set_queue(UltraPingQueueBase *queue) {
+	_queue = queue;
+}
+
+
+void UltraPing::publish(unsigned long result, unsigned int echo, uint8_t hits) { // Set ping_result, and queue the result if there's a queue (not called directly).
+	ping_result = result;
+	if (!_queue) return;
+	UltraPingResult r;
+	r.sonar = this;
+	r.time = micros();
+	r.echo = echo;
+	r.hits = hits;
+	_queue->push(r);
+}
+
+#endif
+
+
+#if ULTRAPING_STATS_ENABLED == true
+
+// ---------------------------------------------------------------------------
+// Instrumentation counters
+// ---------------------------------------------------------------------------
+
+void UltraPing::stats(UltraPingStats &snapshot, boolean reset) {
+	ULTRAPING_ATOMIC_BEGIN(); // Timer methods count from interrupts, copy all counters at once.
+	snapshot = _stats;
+	if (reset) reset_stats();
+	ULTRAPING_ATOMIC_END();
+}
+
+
+void UltraPing::reset_stats() {
+	_stats = UltraPingStats();
+}
+
+#endif
+
+
+// ---------------------------------------------------------------------------
+// Conversion methods (rounds result to nearest cm or inch).
 // ---------------------------------------------------------------------------
 unsigned int UltraPing::convert_length(unsigned int echoTime) {
-	return ULTRAPING_US_2_LENGTH_UNIT(echoTime); // Convert uS to length unit.
+	return ULTRAPING_US_2_LENGTH_UNIT(echoTime, _lengthScale); // Convert uS to length unit.
 }
 
+
+unsigned int UltraPing::convert_mm(unsigned int echoTime) {
+	return ULTRAPING_US_2_LENGTH_UNIT(echoTime, _mmScale); // Convert uS to mm.
+}
+
+
+void UltraPing::convert_length(unsigned int hits[], unsigned int count) {
+	uint32_t scale = _lengthScale; // Read once, not for every hit.
+	for (unsigned int i = 0; i < count; i++) hits[i] = ULTRAPING_US_2_LENGTH_UNIT(hits[i], scale);
+}
+
+
+void UltraPing::convert_mm(unsigned int hits[], unsigned int count) {
+	uint32_t scale = _mmScale;
+	for (unsigned int i = 0; i < count; i++) hits[i] = ULTRAPING_US_2_LENGTH_UNIT(hits[i], scale);
+}
+
+
+#if ULTRAPING_URM37_ENABLED == false
+void UltraPing::set_sound_speed(unsigned int speed) { // The only divisions, done once per change.
+	_lengthScale = sound_scale(speed, ULTRAPING_LENGTH_UNIT_TENTH_MM * 20000UL); // One-way length unit per uS: speed / (2 * 1000000 * unit in cm).
+	_mmScale = sound_scale(speed, 200000UL);
+	_roundtripTime = ((ULTRAPING_LENGTH_UNIT_TENTH_MM * 20000UL << 8) + speed / 2) / speed;
+}
+
+
+uint32_t UltraPing::sound_scale(unsigned int speed, uint32_t length) { // ULTRAPING_SCALE(speed, length), in two steps as speed << 24 doesn't fit in 32 bits.
+	uint32_t high = ((uint32_t) speed << 16) / length;
+	uint32_t rest = ((uint32_t) speed << 16) % length; // Less than length (at most 5080000), 8 more bits fit.
+	return (high << 8) + ((rest << 8) + length - 1) / length;
+}
+
+
+void UltraPing::set_temperature(int8_t temperature, uint8_t humidity) {
+	set_sound_speed(33130 + (606L * temperature) / 10 + (124U * humidity) / 100); // 331.3m/s at 0C, +0.606m/s per C, about +0.0124m/s per % humidity.
+}
+#endif
+
+
+#if ULTRAPING_TRACE_ENABLED == true
+
+// ---------------------------------------------------------------------------
+// Event recording, see UltraPingTrace.h
+// ---------------------------------------------------------------------------
+
+void UltraPing::set_trace(UltraPingTraceBase *trace) {
+	_trace = trace;
+	ULTRAPING_TRACE(ULTRAPING_TRACE_MAX, _maxEchoTime);   // Replay starts from the same state.
+	ULTRAPING_TRACE(ULTRAPING_TRACE_BUDGET, _roundBudget);
+}
+
+
+void UltraPing::trace_event(uint8_t type, unsigned long value) { // Record an event (not called directly).
+	_trace->add(type, value);
+}
+
+#endif
+
+
+#if ULTRAPING_HEALTH_ENABLED == true
+
+// ---------------------------------------------------------------------------
+// Sensor health and quarantine
+// ---------------------------------------------------------------------------
+
+uint8_t UltraPing::health() {
+	return _health;
+}
+
+
+boolean UltraPing::quarantined() {
+	return _healthFails >= ULTRAPING_HEALTH_FAILS;
+}
+
+
+void UltraPing::health_report(uint8_t status) { // Outcome of a ping (not called directly). Quarantines the sensor after HEALTH_FAILS faults in a row, a ping that starts ends it.
+	_health = status;
+	if (status < ULTRAPING_HEALTH_STUCK) { // The sensor answered.
+		boolean released = quarantined();
+		_healthFails = 0;
+		if (released) set_limits();    // Back to the profile's start wait.
+		return;
+	}
+	if (!quarantined()) {
+		if (++_healthFails < ULTRAPING_HEALTH_FAILS) return;
+		_healthBackoff = 0;
+		set_limits();                  // Probes wait a short time for the ping to start.
+	} else if (_healthBackoff < ULTRAPING_HEALTH_BACKOFF_MAX) _healthBackoff++; // Probe failed, wait twice as long for the next.
+	_healthProbe = millis();
+}
+
+
+boolean UltraPing::health_skip() { // Returns true if the sensor is quarantined and not due for a probe (not called directly).
+	if (!quarantined() || millis() - _healthProbe >= ((unsigned long) ULTRAPING_HEALTH_PROBE_MS << _healthBackoff)) return false;
+	ULTRAPING_STAT(quarantined);
+	return true;
+}
+
+#endif
@@ -41,26 +41,40 @@
 // ---------------------------------------------------------------------------
 //
 // FEATURES:
-// * Works with many different ultrasonic sensors: SR04, SRF05, SRF06, DYP-ME007, URM37 & Parallax PING))).
+// * Works with many different ultrasonic sensors: SR04, SRF05, SRF06, DYP-ME007, URM37 & Parallax PING))), with a timing profile per sensor type.
 // * Compatible with the entire Arduino line-up (and clones), Teensy family (including $19 96Mhz 32 bit Teensy 3.2) and non-AVR microcontrollers.
 // * Interface with all but the SRF06 sensor using only one Arduino pin.
 // * Doesn't lag for a full second if no ping/echo is received.
 // * Ping sensors consistently and reliably at up to 30 times per second.
-// * Timer interrupt method for event-driven sketches.
-// * Built-in digital filter method ping_median() for easy error correction.
-// * Uses port registers for a faster pin interface and smaller code size.
+// * Timer interrupt method for event-driven sketches, UltraPingQueue keeps every result until loop() gets to it.
+// * Built-in digital filter method ping_median() for easy error correction, and UltraPingFilter for a median after every ping.
+// * set_yield() gives the waits between the pings of ping_median() and ping_multi() to the sketch.
+// * Uses port registers for a faster pin interface and smaller code size, UltraPingT fixes them at compile-time.
 // * Allows you to set a maximum distance where pings beyond that distance are read as no ping "clear".
-// * Ease of using multiple sensors (example sketch with 15 sensors).
+// * Ease of using multiple sensors (example sketch with 15 sensors, UltraPingArray schedules many sensors, UltraPingBank pings sensors that can't hear each other at once).
+// * set_multi_reuse() lets ping_multi rounds share one first ping, a round after a hit only sends its second ping and skips the settle wait.
+// * With HEALTH_ENABLED, an unplugged sensor or a stuck echo line is quarantined and costs microseconds per ping instead of milliseconds, see health().
+// * calibrate() measures each sensor's own trigger latency and dead time at start-up, ping_multi then wastes no rounds on echos it can't tell apart.
+// * UltraPingTracker follows moving echos over ping_multi calls and aims each round at a predicted echo.
 // * More accurate distance calculation (cm, inches & uS).
 // * Doesn't use pulseIn, which is slow and gives incorrect results with some ultrasonic sensor models.
 // * Possible to see beyond first echo, and set threshold for first measured distance. (Exprimental)
+// * UltraPingFrame packs ping_multi results into compact binary frames for streaming them over a slow serial link.
+// * UltraPingTrace records the raw ping events in the field, so odd results can be replayed through the ping methods on a PC.
 // * Actively developed with features being added and bugs/issues addressed.
 //
 // CONSTRUCTOR:
-//   UltraPing sonar(trigger_pin, echo_pin [, max_distance])
+//   UltraPing sonar(trigger_pin, echo_pin [, max_distance [, profile]])
 //     trigger_pin & echo_pin - Arduino pins connected to sensor trigger and echo.
 //       NOTE: To use the same Arduino pin for trigger and echo, specify the same pin for both values.
 //     max_distance - [Optional] Maximum distance you wish to sense. Default=500cm.
+//     profile - [Optional] Sensor type, one of the profiles below, e.g. UltraPingHCSR04(). Default=UltraPingAnySensor()
+//
+// SENSOR PROFILES:
+//   Timing and echo polarity of a sensor type, chosen per sensor when compiling, so different sensors can share a sketch.
+//   UltraPingAnySensor - Fits every sensor: waits max echo time + MAX_SENSOR_DELAY for a ping to start (the SRF06 can take 34,300uS), echo active as URM37_ENABLED says.
+//   UltraPingHCSR04, UltraPingSRF05, UltraPingSRF06, UltraPingURM37, UltraPingParallaxPing, UltraPingJSNSR04T - Typical timing of that sensor,
+//   so a trigger that doesn't start a ping fails after about 1ms instead of 35ms. The URM37 in PWM mode still needs URM37_ENABLED for its 50uS/cm unit.
 //
 // METHODS:
 //   sonar.ping([max_distance]) - Send a ping and get the echo time (in microseconds) as a result. [max_distance] allows you to optionally set a new max distance.
@@ -68,12 +82,41 @@
 //   sonar.ping_median(iterations [, max_distance]) - Do multiple pings (default=5), discard out of range pings and return median in microseconds. [max_distance] allows you to optionally set a new max distance.
 //   sonar.ping_multi(hits[], maximum_hits, [threshold_distance], [max_distance]) - Exprimental! Detects several echo at different distance and return number of hits. Echo times of hits in the array.
 //   ping_threshold(threshold_distance, [max_distance]) - Exprimental! Return echo time for first echo beyond threshold_distance. (Uses ping_multi internal)
+//   sonar.set_round_budget(rounds) - Maximum rounds (first and second ping) per ping_multi call, bounds the latency. Default=0 (no limit)
+//   sonar.multi_rounds - Rounds used by the last ping_multi or ping_multi_timer.
+//   sonar.set_multi_reuse(rounds) - Let up to rounds (max MULTI_REUSE_MAX) ping_multi rounds share one first ping: after a hit, the next second ping goes out from the same first ping
+//   without waiting for echos to ebb away, one trigger for that round. Known echos of the earlier second pings are told from new ones. Rounds after a rejected window, or that would listen
+//   on an echo of an earlier second ping, still measure the first echo again (the sensor is deaf until the last echo ended, and an echo of the first ping hiding under it would be lost),
+//   so only runs of hits save triggers: in the simulator 12 -> 11 triggers for 4 echos, 13.4 -> 13.1 triggers a call over random scenes, but 13-18% less time. Not with a threshold_distance or probes, or ping_multi_timer. Default=0 (off)
+//   sonar.set_multi_probes(probes[], count) - Echo times (uS, ascending) where the next ping_multi or ping_multi_timer expects echos. With a round budget, it aims a round at each probe and searches the gaps with the rounds left over. See UltraPingTracker.
+//   UltraPing::set_yield(function, budget) - Call function (which returns within budget uS) while ping_median and ping_multi wait between pings, instead of only delaying. Never while an echo is timed. NULL to stop.
+//   sonar.calibrate([&result]) - Time this sensor with short probe pings: trigger latency, dead time and how soon after an echo a second ping listens. Replaces the profile's
+//   start_delay (2 x longest latency), dead_time and min_separation, so ping_multi skips offsets the sensor can't resolve. Needs something to reflect within max distance, returns false otherwise.
+//   sonar.settle_time() - Microseconds ping_median and ping_multi wait for echos to ebb away between pings. With SETTLE_ADAPTIVE it's learned, between 2 x max echo time and PING_MEDIAN_DELAY.
 //   UltraPing::convert_length(echoTime) - Convert echoTime from microseconds to length unit (rounds to nearest integer). Depends on LENGTH_UNIT_CM or LENGTH_UNIT_INCH
-//   sonar.ping_timer(function [, max_distance]) - Send a ping and call function to test if ping is complete. [max_distance] allows you to optionally set a new max distance.
+//   UltraPing::convert_mm(echoTime) - Convert echoTime from microseconds to millimeters.
+//   UltraPing::convert_length(hits[], count) / UltraPing::convert_mm(hits[], count) - Convert count echo times, like the hits from ping_multi, in place.
+//   UltraPing::set_temperature(temperature [, humidity]) - Set speed of sound from air temperature in Celsius (and relative humidity in %), used by all conversions. Default uses US_ROUNDTRIP_LENGTH.
+//   UltraPing::set_sound_speed(speed) - Set speed of sound in cm/s, e.g. 34300. Max distances already set keep their limit in uS until set again.
+//   sonar.ping_timer(function [, max_distance]) - Send a ping and call function to test if ping is complete. [max_distance] allows you to optionally set a new max distance. Returns false if the ping didn't start, or if all TIMER_SLOTS are taken (no ping is sent then).
 //   sonar.check_timer() - Check if ping has returned within the set distance limit.
+//   sonar.ping_multi_timer(hits[], maximum_hits, function, [threshold_distance], [max_distance]) - Exprimental! Same as ping_multi, but runs in the background from the timer interrupt, calls function to advance the measurement. Returns false if the sensor is busy, all TIMER_SLOTS are taken, or another ping_multi_timer is still running (only one at a time).
+//   sonar.check_multi_timer() - Advance ping_multi_timer, returns true when done. Number of hits in ping_result, echo times of hits in the array.
+//   sonar.ping_edge(function [, max_distance]) - Send a ping and time the echo with an interrupt on each echo edge instead of polling, calls function when the echo is done. Echo pin must support attachInterrupt() (or be the ICP1 pin with EDGE_ICP1). Returns false if the sensor is busy.
+//   sonar.check_edge() - Check if ping_edge has returned within the set distance limit (result in ping_result). Call from loop to time-out a ping that never returns.
+//   sonar.set_queue(&queue) - Also add every result of ping_timer, ping_multi_timer and ping_edge to queue, so none is lost or read half-written. NULL to stop. See UltraPingQueue.
 //   UltraPing::timer_us(frequency, function) - Call function every frequency microseconds.
 //   UltraPing::timer_ms(frequency, function) - Call function every frequency milliseconds.
-//   UltraPing::timer_stop() - Stop the timer.
+//   UltraPing::timer_stop() - Stop the timer, with all timer_us, timer_ms, ping_timer and ping_multi_timer.
+//   Every sensor's ping_timer or ping_multi_timer, timer_us, timer_ms and UltraPingArray take one of TIMER_SLOTS slots on the same timer,
+//   so pings of several sensors and the schedules can run at once. Periods that aren't a multiple of the shortest one in use get jitter up to it.
+//   sonar.stats(snapshot, [reset]) - With STATS_ENABLED, copy the counters of this sensor to snapshot (an UltraPingStats), optionally resetting them. Safe while timer methods run.
+//   sonar.reset_stats() - With STATS_ENABLED, reset the counters.
+//   sonar.health() - With HEALTH_ENABLED, what the last ping of ping, ping_median, ping_multi, ping_timer, UltraPingArray or UltraPingBank says about the sensor: ULTRAPING_HEALTH_OK,
+//   _NO_ECHO, _STUCK (echo active at the trigger) or _NO_START. After HEALTH_FAILS _STUCK or _NO_START in a row the sensor is quarantined: its pings return NO_ECHO at once,
+//   except a probe every HEALTH_PROBE_MS (doubling while it fails) that only waits start_delay, or MAX_SENSOR_DELAY, for the ping to start. A ping that starts ends the quarantine.
+//   sonar.quarantined() - With HEALTH_ENABLED, true while the sensor is quarantined.
+//   sonar.set_trace(&trace) - With TRACE_ENABLED, record what ping, ping_median and ping_multi do (triggers, echo start and end, offsets, results) in trace. NULL to stop. See UltraPingTrace.
 //
 // HISTORY UltraPing:
 //  2017-01-29 UltraPing v1.0 - Lasse Löfquist forked NewPing, renamed to
@@ -165,7 +208,9 @@
 #ifndef UltraPing_h
 #define UltraPing_h
 
-#if defined (ARDUINO) && ARDUINO >= 100
+#if defined (ULTRAPING_SIM)
+	#include <UltraPingSim.h> // Host-side simulated hardware, see extras/sim/UltraPingSim.h
+#elif defined (ARDUINO) && ARDUINO >= 100
 	#include <Arduino.h>
 #else
 	#include <WProgram.h>
@@ -184,8 +229,10 @@
 
 #if defined (ULTRAPING_LENGTH_UNIT_CM)
 	#define ULTRAPING_US_ROUNDTRIP_LENGTH 57      // Microseconds (uS) it takes sound to travel round-trip 1cm (2cm total), uses integer to save compiled code space. Default=57
+	#define ULTRAPING_LENGTH_UNIT_TENTH_MM 100    // Length unit in 0.1mm.
 #elif defined (ULTRAPING_LENGTH_UNIT_INCH)
 	#define ULTRAPING_US_ROUNDTRIP_LENGTH 146     // Microseconds (uS) it takes sound to travel round-trip 1 inch (2 inches total), uses integer to save compiled code space. Defalult=146
+	#define ULTRAPING_LENGTH_UNIT_TENTH_MM 254    // Length unit in 0.1mm.
 #else
 Choose one length unit!
 #endif
@@ -205,6 +252,30 @@ Choose one length unit!
 #ifndef ULTRAPING_TIMER_ENABLED
 	#define ULTRAPING_TIMER_ENABLED true      // Set to "false" to disable the timer ISR (if getting "__vector_7" compile errors set this to false). Default=true
 #endif
+#ifndef ULTRAPING_SETTLE_ADAPTIVE
+	#define ULTRAPING_SETTLE_ADAPTIVE false   // Set to "true" to learn how long echos last, instead of always waiting PING_MEDIAN_DELAY for them to ebb away between pings in ping_median and ping_multi. Shortens the waits in a room without far echos. Default=false
+#endif
+#ifndef ULTRAPING_EDGE_ENABLED
+	#define ULTRAPING_EDGE_ENABLED true       // Set to "false" to disable the edge interrupt ping_edge method, saves a byte per sensor when using port registers. Default=true
+#endif
+#ifndef ULTRAPING_EDGE_ICP1
+	#define ULTRAPING_EDGE_ICP1 false         // Set to "true" to time ping_edge with Timer1 input capture instead of attachInterrupt() (ATmega168/328 only, echo pin must be ICP1 = pin 8, takes over Timer1). Default=false
+#endif
+#ifndef ULTRAPING_FAST_CLOCK
+	#define ULTRAPING_FAST_CLOCK false        // Set to "true" to time ping, ping_median and ping_multi with a hardware counter instead of micros(): Timer1 at 0.5uS on ATmega168/328 (takes over Timer1, no PWM on pins 9 & 10), the cycle counter on Teensy 3.x. Other boards keep micros(). Default=false
+#endif
+#ifndef ULTRAPING_TRACE_ENABLED
+	#define ULTRAPING_TRACE_ENABLED false     // Set to "true" to make set_trace() available, for recording the raw events of a ping and replaying them on a PC. Costs 2 bytes of RAM per sensor, and a call per event while recording. Default=false
+#endif
+#ifndef ULTRAPING_TIMER_SLOTS
+	#define ULTRAPING_TIMER_SLOTS 4           // Number of ping_timer/ping_multi_timer pings, timer_us, timer_ms and UltraPingArray that can use the timer at once. Costs 12 bytes of RAM each. Default=4
+#endif
+#ifndef ULTRAPING_STATS_ENABLED
+	#define ULTRAPING_STATS_ENABLED false     // Set to "true" to count triggers, aborts, time-outs and rounds per sensor, see stats(). Costs 44 bytes of RAM per sensor and a few instructions per ping. Default=false
+#endif
+#ifndef ULTRAPING_HEALTH_ENABLED
+	#define ULTRAPING_HEALTH_ENABLED false    // Set to "true" to track the health of each sensor and quarantine a failing one, see health(). Costs 7 bytes of RAM per sensor. Default=false
+#endif
 
 
 // Probably shouldn't change these values unless you really know what you're doing.
@@ -212,6 +283,16 @@ Choose one length unit!
 #define ULTRAPING_MAX_SENSOR_DELAY 5800   // Maximum uS it takes for sensor to start the ping. Default=5800
 #define ULTRAPING_ECHO_TIMER_FREQ 24      // Frequency to check for a ping echo (every 24uS is about 0.4cm accuracy). Default=24
 #define ULTRAPING_PING_MEDIAN_DELAY 29000 // Microsecond delay between pings in the ping_median method. Default=29000
+#define ULTRAPING_SETTLE_TIMER_FREQ 1000  // Frequency to check if echos have ebbed away in ping_multi_timer. Default=1000
+#define ULTRAPING_TIMER_MAX_TICK 1000     // Longest period of the timer interrupt, longer periods are counted in ticks (max 1020uS on Timer2/Timer4). Default=1000
+#define ULTRAPING_SETTLE_CREEP 16         // With SETTLE_ADAPTIVE, the settle time shrinks by 1/SETTLE_CREEP after each ping without early echos, and doubles on an early echo. Default=16
+#define ULTRAPING_MULTI_GUARD 50          // uS overlap between the windows probed by ping_multi rounds, on top of the start delay jitter seen. Default=50
+#define ULTRAPING_MULTI_REUSE_MAX 4       // Most ping_multi rounds set_multi_reuse lets share one first ping, costs 2 bytes of stack (RAM with ping_multi_timer) each. Default=4
+#define ULTRAPING_HEALTH_FAILS 3          // Failed pings in a row (echo stuck active or no start) that quarantine a sensor. Default=3
+#define ULTRAPING_HEALTH_PROBE_MS 100     // Milliseconds from quarantine until a ping probes the sensor again, doubles after every failed probe. Default=100
+#define ULTRAPING_HEALTH_BACKOFF_MAX 6    // Most doublings of the probe interval (100ms x 64 = 6.4s). Default=6
+#define ULTRAPING_CALIBRATE_PINGS 8       // Pings calibrate() times the trigger latency over. Default=8
+#define ULTRAPING_CALIBRATE_STEP 10       // uS resolution of the dead time found by calibrate(). Default=10
 #define ULTRAPING_PING_OVERHEAD 5         // Ping overhead in microseconds (uS). Default=5
 #define ULTRAPING_PING_TIMER_OVERHEAD 13  // Ping timer overhead in microseconds (uS). Default=13
 
@@ -223,32 +304,67 @@ Choose one length unit!
 		#define ULTRAPING_US_ROUNDTRIP_LENGTH 127 // If 50uS is 1cm, 1 inch would be 127uS (50 x 2.54 = 127). Default=127
 	#endif
 
-	#define ULTRAPING_ISACTIVE(VALUE) (!(VALUE))
-	#define ULTRAPING_ISNOTACTIVE(VALUE) (VALUE)
-#else
-	#define ULTRAPING_ISACTIVE(VALUE) (VALUE)
-	#define ULTRAPING_ISNOTACTIVE(VALUE) (!(VALUE))
 #endif
 
+// Sensor profiles, see SENSOR PROFILES above.
+//   start_delay - Longest uS from trigger to ping start (echo active), a ping that hasn't started by then fails. 0 = max echo time + MAX_SENSOR_DELAY.
+//   dead_time - uS after an echo ends before the sensor takes a new trigger, ping_multi doesn't send its second ping earlier.
+//   min_separation - Closest uS between two echos that the sensor tells apart, ping_multi doesn't look for a hit closer to the last one.
+//   active_low - Echo pin is low while active.
+#define ULTRAPING_PROFILE(NAME, START_DELAY, DEAD_TIME, MIN_SEPARATION, ACTIVE_LOW) \
+	struct NAME { \
+		static const unsigned int start_delay = START_DELAY; \
+		static const unsigned int dead_time = DEAD_TIME; \
+		static const unsigned int min_separation = MIN_SEPARATION; \
+		static const boolean active_low = ACTIVE_LOW; \
+	};
+
+ULTRAPING_PROFILE(UltraPingAnySensor,    0,    0,    0, ULTRAPING_URM37_ENABLED) // The timing before profiles, slow but safe for all.
+ULTRAPING_PROFILE(UltraPingHCSR04,       1000, 10,   300, false) // Starts about 450uS after the trigger, 8 cycle burst.
+ULTRAPING_PROFILE(UltraPingSRF05,        1000, 10,   300, false)
+ULTRAPING_PROFILE(UltraPingSRF06,        0,    10,   300, false) // Can take 34,300uS to start.
+ULTRAPING_PROFILE(UltraPingURM37,        0,    0,    0,   true)  // PWM mode, echo pulse is low.
+ULTRAPING_PROFILE(UltraPingParallaxPing, 1000, 200,  300, false) // Starts 750uS after the trigger, 200uS before the next measurement.
+ULTRAPING_PROFILE(UltraPingJSNSR04T,     1000, 10,   1200, false) // One transducer, rings for about 20cm.
+
+struct UltraPingCalibration {    // What calibrate() measured on this sensor, uS.
+	unsigned int latency_min;    // Trigger to ping start (echo active), shortest and longest seen.
+	unsigned int latency_max;
+	unsigned int dead_time;      // Echo end to the first trigger the sensor takes.
+	unsigned int min_separation; // Echo end to the start of that ping, the closest a second ping listens after an echo.
+};
+
 //Used in ping_multi
 #define ULTRAPING_THREE_QUARTERS(VALUE) (((VALUE) / 2 + (VALUE) / 4)) // Bitwise approx for VALUE * .75
 
 
-// Conversion from uS to distance
+// Conversion from uS to distance, multiply with a precomputed reciprocal (scale / 2^24, rounded up) instead of dividing.
+// For every 16-bit echo time the result is the same as dividing by US_ROUNDTRIP_LENGTH. The scale is multiplied in 16-bit halves, so no product needs more than 32 bits.
+#define ULTRAPING_SCALE_SHIFT 24
+#define ULTRAPING_SCALE(UNITS_PER_US_NUM, UNITS_PER_US_DEN) ((((uint32_t) (UNITS_PER_US_NUM) << ULTRAPING_SCALE_SHIFT) + (UNITS_PER_US_DEN) - 1) / (UNITS_PER_US_DEN))
+#define ULTRAPING_SCALE_MUL(echoTime, scale) ((uint32_t) (echoTime) * (uint16_t) ((scale) >> 16) + (((uint32_t) (echoTime) * (uint16_t) (scale)) >> 16)) // echoTime * scale / 65536.
 #if ULTRAPING_ROUNDING_ENABLED == false
-	#define ULTRAPING_US_2_LENGTH_UNIT(echoTime) (echoTime / ULTRAPING_US_ROUNDTRIP_LENGTH)
+	#define ULTRAPING_US_2_LENGTH_UNIT(echoTime, scale) ((unsigned int) (ULTRAPING_SCALE_MUL(echoTime, scale) >> (ULTRAPING_SCALE_SHIFT - 16)))
 #else
 	//(round result to nearest cm or inch).
-	#define ULTRAPING_US_2_LENGTH_UNIT(echoTime) (max(((unsigned int)echoTime + ULTRAPING_US_ROUNDTRIP_LENGTH / 2) / ULTRAPING_US_ROUNDTRIP_LENGTH, (echoTime ? 1 : 0)))
+	#define ULTRAPING_US_2_LENGTH_UNIT(echoTime, scale) (max((unsigned int) ((ULTRAPING_SCALE_MUL(echoTime, scale) + (1UL << (ULTRAPING_SCALE_SHIFT - 17))) >> (ULTRAPING_SCALE_SHIFT - 16)), (echoTime ? 1 : 0)))
 #endif
 
 // Detect non-AVR microcontrollers (Teensy 3.x, Arduino DUE, etc.) and don't use port registers or timer interrupts as required.
-#if (defined (__arm__) && defined (TEENSYDUINO))
+#if defined (ULTRAPING_SIM) // Simulated hardware on host, timer methods use the simulated IntervalTimer.
+	#undef  ULTRAPING_PING_OVERHEAD
+	#define ULTRAPING_PING_OVERHEAD 1
+	#undef  ULTRAPING_PING_TIMER_OVERHEAD
+	#define ULTRAPING_PING_TIMER_OVERHEAD 1
+	#define ULTRAPING_DO_BITWISE false
+	#define ULTRAPING_INTERVAL_TIMER true
+#elif (defined (__arm__) && defined (TEENSYDUINO))
 	#undef  ULTRAPING_PING_OVERHEAD
 	#define ULTRAPING_PING_OVERHEAD 1
 	#undef  ULTRAPING_PING_TIMER_OVERHEAD
 	#define ULTRAPING_PING_TIMER_OVERHEAD 1
 	#define ULTRAPING_DO_BITWISE true
+	#define ULTRAPING_INTERVAL_TIMER true
 #elif !defined (__AVR__)
 	#undef  ULTRAPING_PING_OVERHEAD
 	#define ULTRAPING_PING_OVERHEAD 1
@@ -257,16 +373,151 @@ Choose one length unit!
 	#undef  ULTRAPING_TIMER_ENABLED
 	#define ULTRAPING_TIMER_ENABLED false
 	#define ULTRAPING_DO_BITWISE false
+	#define ULTRAPING_INTERVAL_TIMER false
 #else
 	#define ULTRAPING_DO_BITWISE true
+	#define ULTRAPING_INTERVAL_TIMER false
 #endif
 
+// Timestamps for the blocking ping loops. Differences of ticks are wrap safe, as long as they fit the type.
+#if ULTRAPING_FAST_CLOCK == true && defined (ULTRAPING_SIM)
+	typedef uint16_t ultraping_ticks;             // Simulated Timer1, see UltraPingSim::timer1().
+	#define ULTRAPING_TICKS() UltraPingSim::timer1()
+	#define ULTRAPING_TICKS_PER_US 2
+	#define ULTRAPING_TICKS_BEGIN() ((void) 0)
+#elif ULTRAPING_FAST_CLOCK == true && (defined (__AVR_ATmega168__) || defined (__AVR_ATmega168P__) || defined (__AVR_ATmega328__) || defined (__AVR_ATmega328P__))
+	typedef uint16_t ultraping_ticks;             // Timer1 with prescaler 8, wraps every 32ms at 16MHz.
+	#define ULTRAPING_TICKS() TCNT1
+	#define ULTRAPING_TICKS_PER_US (F_CPU / 8000000L)
+	#define ULTRAPING_TICKS_BEGIN() (TCCR1A = 0, TCCR1B = (TCCR1B & (1<<ICES1)) | (1<<CS11)) // Normal mode, prescaler 8. Arduino's init() sets Timer1 up for PWM after the constructors run, so this is done before every ping.
+#elif ULTRAPING_FAST_CLOCK == true && defined (__arm__) && defined (TEENSYDUINO) && defined (ARM_DWT_CYCCNT)
+	typedef uint32_t ultraping_ticks;             // CPU cycles.
+	#define ULTRAPING_TICKS() ARM_DWT_CYCCNT
+	#define ULTRAPING_TICKS_PER_US (F_CPU / 1000000L)
+	#define ULTRAPING_TICKS_BEGIN() (ARM_DEMCR |= ARM_DEMCR_TRCENA, ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA)
+#else
+	#undef  ULTRAPING_FAST_CLOCK
+	#define ULTRAPING_FAST_CLOCK false
+	typedef unsigned long ultraping_ticks;
+	#define ULTRAPING_TICKS() micros()
+	#define ULTRAPING_TICKS_PER_US 1
+	#define ULTRAPING_TICKS_BEGIN() ((void) 0)
+#endif
+#define ULTRAPING_ELAPSED(SINCE) ((ultraping_ticks) (ULTRAPING_TICKS() - (SINCE)))
+#define ULTRAPING_TICKS_LIMIT ((unsigned long) (ultraping_ticks) -1 - 1000) // Longest wait in ticks, with a margin for the loop to see it before the counter wraps.
+#define ULTRAPING_TICKS_2_US(TICKS) ((unsigned long) (TICKS) / ULTRAPING_TICKS_PER_US)
+
 // Disable the timer interrupts when using ATmega128 and all ATtiny microcontrollers.
 #if defined (__AVR_ATmega128__) || defined (__AVR_ATtiny24__) || defined (__AVR_ATtiny44__) || defined (__AVR_ATtiny84__) || defined (__AVR_ATtiny25__) || defined (__AVR_ATtiny45__) || defined (__AVR_ATtiny85__) || defined (__AVR_ATtiny261__) || defined (__AVR_ATtiny461__) || defined (__AVR_ATtiny861__) || defined (__AVR_ATtiny43U__)
 	#undef  ULTRAPING_TIMER_ENABLED
 	#define ULTRAPING_TIMER_ENABLED false
 #endif
 
+// Timer1 input capture is only supported on ATmega168/328. Without input capture, ping_edge needs digitalPinToInterrupt().
+#if ULTRAPING_EDGE_ICP1 == true && !(defined (__AVR_ATmega168__) || defined (__AVR_ATmega328__) || defined (__AVR_ATmega328P__))
+	#undef  ULTRAPING_EDGE_ICP1
+	#define ULTRAPING_EDGE_ICP1 false
+#endif
+#if ULTRAPING_EDGE_ENABLED == true && ULTRAPING_EDGE_ICP1 == false && !defined (digitalPinToInterrupt)
+	#undef  ULTRAPING_EDGE_ENABLED
+	#define ULTRAPING_EDGE_ENABLED false
+#endif
+#if ULTRAPING_EDGE_ICP1 == true
+	#if ULTRAPING_URM37_ENABLED == true
+		#define ULTRAPING_ICP1_START_EDGE 0          // URM37 echo is active low, ping starts on falling edge.
+	#else
+		#define ULTRAPING_ICP1_START_EDGE (1<<ICES1) // Ping starts on rising edge.
+	#endif
+	#define ULTRAPING_ICP1_COUNTS_PER_US (F_CPU / 8000000L) // Timer1 counts per uS with prescaler 8 (2 at 16MHz, 0.5uS resolution).
+	#define ULTRAPING_ICP1_WRAP_US (65536L / ULTRAPING_ICP1_COUNTS_PER_US) // uS until Timer1 wraps (32768 at 16MHz), shorter than a sensor's no echo time-out.
+#endif
+
+// Interrupts off from ULTRAPING_ATOMIC_BEGIN() to ULTRAPING_ATOMIC_END() in the same block, then back as they were (also inside an interrupt).
+#if defined (__AVR__)
+	#define ULTRAPING_ATOMIC_BEGIN() uint8_t _atomicState = SREG; cli()
+	#define ULTRAPING_ATOMIC_END() (SREG = _atomicState)
+#elif defined (__arm__) && defined (TEENSYDUINO)
+	#define ULTRAPING_ATOMIC_BEGIN() uint32_t _atomicState; __asm__ __volatile__ ("mrs %0, primask\n\tcpsid i" : "=r" (_atomicState) :: "memory")
+	#define ULTRAPING_ATOMIC_END() __asm__ __volatile__ ("msr primask, %0" :: "r" (_atomicState) : "memory")
+#else
+	#define ULTRAPING_ATOMIC_BEGIN() ((void) 0) // The simulator only runs interrupts when the clock advances.
+	#define ULTRAPING_ATOMIC_END() ((void) 0)
+#endif
+
+// Counters for stats(), compiled to nothing when STATS_ENABLED is false.
+#if ULTRAPING_STATS_ENABLED == true
+	struct UltraPingStats {
+		unsigned long triggers;        // Trigger pulses sent.
+		unsigned long trigger_aborts;  // Triggers not sent, echo still active from the previous ping.
+		unsigned long start_timeouts;  // Pings that didn't start within the profile's start_delay.
+		unsigned long echo_timeouts;   // Pings without echo within max distance.
+		unsigned long rounds;          // ping_multi rounds (first and second ping).
+		unsigned long early_echos;     // Pings redone by ping_median and ping_multi, an echo from the previous ping came back.
+		unsigned long probes_accepted; // ping_multi second pings that heard an echo from the first ping (a hit).
+		unsigned long probes_rejected; // ping_multi second pings that heard their own echo.
+		unsigned long busy_us;         // uS spent blocking in ping, ping_median and ping_multi.
+		unsigned long yields;          // Calls to the set_yield function from ping_median and ping_multi waits.
+		unsigned long quarantined;     // Pings skipped, the sensor was quarantined (HEALTH_ENABLED).
+	};
+
+	struct UltraPingStatsBusy {        // Adds the uS from construction to destruction to a counter.
+		unsigned long &total;
+		unsigned long start;
+		UltraPingStatsBusy(unsigned long &counter) : total(counter), start(micros()) {}
+		~UltraPingStatsBusy() { total += micros() - start; }
+	};
+
+	#define ULTRAPING_STAT(FIELD) (_stats.FIELD++)
+	#define ULTRAPING_STAT_OF(SONAR, FIELD) ((SONAR)._stats.FIELD++)
+	#define ULTRAPING_STAT_BUSY() UltraPingStatsBusy _statsBusy(_stats.busy_us)
+#else
+	#define ULTRAPING_STAT(FIELD) ((void) 0)
+	#define ULTRAPING_STAT_OF(SONAR, FIELD) ((void) 0)
+	#define ULTRAPING_STAT_BUSY() ((void) 0)
+#endif
+
+// Health of a sensor, see health(). Compiled to nothing when HEALTH_ENABLED is false.
+#define ULTRAPING_HEALTH_OK       0 // Last ping started.
+#define ULTRAPING_HEALTH_NO_ECHO  1 // Last ping started, but no echo came back within max distance (nothing in range, or a deaf sensor).
+#define ULTRAPING_HEALTH_STUCK    2 // Echo was active at the trigger (echo line stuck active, or an echo that never returns).
+#define ULTRAPING_HEALTH_NO_START 3 // Ping didn't start (unplugged, or echo line stuck inactive).
+#if ULTRAPING_HEALTH_ENABLED == true
+	#define ULTRAPING_HEALTH(STATUS) health_report(STATUS)
+	#define ULTRAPING_HEALTH_OF(SONAR, STATUS) ((SONAR).health_report(STATUS))
+	#define ULTRAPING_HEALTH_SKIP() health_skip()
+	#define ULTRAPING_HEALTH_SKIP_OF(SONAR) ((SONAR).health_skip())
+	#define ULTRAPING_HEALTH_QUARANTINED() quarantined()
+#else
+	#define ULTRAPING_HEALTH(STATUS) ((void) 0)
+	#define ULTRAPING_HEALTH_OF(SONAR, STATUS) ((void) 0)
+	#define ULTRAPING_HEALTH_SKIP() (false)
+	#define ULTRAPING_HEALTH_SKIP_OF(SONAR) (false)
+	#define ULTRAPING_HEALTH_QUARANTINED() (false)
+#endif
+
+// Events recorded with set_trace(), compiled to nothing when TRACE_ENABLED is false. See UltraPingTrace.h for the values.
+#define ULTRAPING_TRACE_MAX       0  // Max echo time in uS, when the trace is set.
+#define ULTRAPING_TRACE_PING      1  // ping() called, max_distance.
+#define ULTRAPING_TRACE_MEDIAN    2  // ping_median() called, iterations. Followed by an ARG with max_distance.
+#define ULTRAPING_TRACE_MULTI     3  // ping_multi() called, maximum_hits. Followed by ARGs with threshold_distance and max_distance.
+#define ULTRAPING_TRACE_ARG       4  // More arguments of the call.
+#define ULTRAPING_TRACE_TRIGGER   5  // Trigger pulse sent, uS since the previous one.
+#define ULTRAPING_TRACE_ABORT     6  // Trigger not sent, echo still active.
+#define ULTRAPING_TRACE_START     7  // Ping started (echo active), uS after the trigger.
+#define ULTRAPING_TRACE_NO_START  8  // Ping didn't start.
+#define ULTRAPING_TRACE_ECHO      9  // Echo ended, uS after the ping started.
+#define ULTRAPING_TRACE_NO_ECHO   10 // No echo within max distance.
+#define ULTRAPING_TRACE_OFFSET    11 // ping_multi second ping, uS after the first ping started.
+#define ULTRAPING_TRACE_RESULT    12 // Value returned by the call.
+#define ULTRAPING_TRACE_HIT       13 // One hit of ping_multi, uS. Follows its RESULT.
+#define ULTRAPING_TRACE_BUDGET    14 // set_round_budget() called, rounds.
+#define ULTRAPING_TRACE_EVENTS    15
+#if ULTRAPING_TRACE_ENABLED == true
+	#define ULTRAPING_TRACE(TYPE, VALUE) (_trace ? trace_event(TYPE, VALUE) : (void) 0)
+#else
+	#define ULTRAPING_TRACE(TYPE, VALUE) ((void) 0)
+#endif
+
 // Define timers when using ATmega8, ATmega16, ATmega32 and ATmega8535 microcontrollers.
 #if defined (__AVR_ATmega8__) || defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__) || defined (__AVR_ATmega8535__)
 	#define OCR2A OCR2
@@ -274,27 +525,106 @@ Choose one length unit!
 	#define OCIE2A OCIE2
 #endif
 
+class UltraPingQueueBase;
+class UltraPingTraceBase;
+
 class UltraPing {
 	public:
 		UltraPing(uint8_t trigger_pin, uint8_t echo_pin, unsigned int max_distance = ULTRAPING_MAX_SENSOR_DISTANCE);
+		template <class PROFILE> UltraPing(uint8_t trigger_pin, uint8_t echo_pin, unsigned int max_distance, PROFILE) : UltraPing(trigger_pin, echo_pin, max_distance) {
+			set_profile(PROFILE::start_delay, PROFILE::dead_time, PROFILE::min_separation, PROFILE::active_low);
+		}
 		unsigned int ping(unsigned int max_distance = 0);
 
 		unsigned int ping_multi(unsigned int hits[], unsigned int maximum_hits, unsigned int threshold_distance = 0, unsigned int max_distance = 0);
 		unsigned int ping_threshold(unsigned int threshold_distance, unsigned int max_distance = 0);
+		void set_round_budget(uint8_t rounds);
+		void set_multi_probes(const unsigned int probes[], uint8_t count);
+		void set_multi_reuse(uint8_t rounds);
+		unsigned int settle_time();
+		static void set_yield(void (*userFunc)(void), unsigned int budget);
+		boolean calibrate(UltraPingCalibration *result = NULL);
+		uint8_t multi_rounds;
 
 		unsigned long ping_length(unsigned int max_distance = 0);
 		unsigned long ping_median(uint8_t it = 5, unsigned int max_distance = 0);
 		static unsigned int convert_length(unsigned int echoTime);
+		static unsigned int convert_mm(unsigned int echoTime);
+		static void convert_length(unsigned int hits[], unsigned int count);
+		static void convert_mm(unsigned int hits[], unsigned int count);
+#if ULTRAPING_URM37_ENABLED == false
+		static void set_sound_speed(unsigned int speed);
+		static void set_temperature(int8_t temperature, uint8_t humidity = 0);
+#endif
 #if ULTRAPING_TIMER_ENABLED == true
-		void ping_timer(void (*userFunc)(void), unsigned int max_distance = 0);
+		boolean ping_timer(void (*userFunc)(void), unsigned int max_distance = 0);
 		boolean check_timer();
-		unsigned long ping_result;
+		boolean ping_multi_timer(unsigned int hits[], unsigned int maximum_hits, void (*userFunc)(void), unsigned int threshold_distance = 0, unsigned int max_distance = 0);
+		boolean check_multi_timer();
 		static void timer_us(unsigned int frequency, void (*userFunc)(void));
 		static void timer_ms(unsigned long frequency, void (*userFunc)(void));
 		static void timer_stop();
+		static void timer_dispatch(); // Timer interrupt handler (not called directly).
+#endif
+#if ULTRAPING_EDGE_ENABLED == true
+		boolean ping_edge(void (*userFunc)(void), unsigned int max_distance = 0);
+		boolean check_edge();
+		static void edge_isr(); // Echo edge interrupt handler (not called directly).
+#endif
+#if ULTRAPING_TIMER_ENABLED == true || ULTRAPING_EDGE_ENABLED == true
+		unsigned long ping_result;
+		void set_queue(UltraPingQueueBase *queue);
 #endif
+#if ULTRAPING_STATS_ENABLED == true
+		void stats(UltraPingStats &snapshot, boolean reset = false);
+		void reset_stats();
+#endif
+#if ULTRAPING_TRACE_ENABLED == true
+		void set_trace(UltraPingTraceBase *trace);
+#endif
+#if ULTRAPING_HEALTH_ENABLED == true
+		uint8_t health();
+		boolean quarantined();
+#endif
+	protected:
+		template <class PINS> unsigned int ping_pins(unsigned int max_distance);
+		template <class PINS> unsigned int ping_multi_pins(unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance);
+		template <class PINS> unsigned long ping_median_pins(uint8_t it, unsigned int max_distance);
+		template <class PINS> unsigned int ping_traced(unsigned int max_distance);
+		template <class PINS> unsigned int ping_multi_traced(unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance);
+		template <class PINS> unsigned long ping_median_traced(uint8_t it, unsigned int max_distance);
+		template <class PINS> boolean ping_trigger_pins();
+		template <class PINS> boolean ping_send_pins();
+		template <class PINS> inline boolean ping_started_pins();
 	private:
+		friend class UltraPingArrayBase;
+		friend class UltraPingBankBase;
+		friend struct UltraPingRuntimePins;
+
+		struct multi_state {             // Progress of a ping_multi measurement.
+			unsigned int *hit;
+			unsigned int maximum_hits;
+			unsigned int hits;           // Number of hits found so far.
+			unsigned int offset;         // uS after first ping to start second ping.
+			unsigned int threshold;      // uS, threshold_distance converted.
+			unsigned int first_length;   // uS, echo time of first ping.
+			unsigned int first_ref;      // uS, echo time of first ping in the first round.
+			unsigned long first_start;   // micros() when first ping started.
+			unsigned long first_max_time;
+			unsigned long settle_time;   // micros() when echos have ebbed away (ping_multi_timer only).
+			uint8_t rounds;              // Rounds (first and second ping) used so far.
+			unsigned int latency_min;    // uS, shortest and longest delay seen from second trigger until it listens.
+			unsigned int latency_max;
+			const unsigned int *probes;  // uS, expected echos to aim rounds at.
+			uint8_t probe_count;
+			uint8_t probe_next;
+			unsigned int last_end;       // uS after first ping started that the last ping of the round ended.
+			uint8_t reused;              // Rounds that have reused the first ping, see set_multi_reuse.
+			unsigned int second_start[ULTRAPING_MULTI_REUSE_MAX]; // uS after first ping started that each second ping of those rounds started, known echos of them come back too.
+		};
+
 		inline boolean readEcho();
+		inline boolean echoActive();
 		inline void setTriggerActive();
 		inline void setTriggerNotActive();
 #if ULTRAPING_ONE_PIN_ENABLED == true
@@ -303,12 +633,61 @@ class UltraPing {
 #endif
 
 		boolean ping_trigger();
+		boolean ping_send();
+		inline boolean ping_started();
 		void set_max_distance(unsigned int max_distance);
+		void set_profile(unsigned int start_delay, unsigned int dead_time, unsigned int min_separation, boolean active_low);
+		void set_limits();
+		unsigned long start_wait();
+		boolean calibrate_probe(UltraPingCalibration &c);
+		boolean calibrate_start(unsigned long wait, unsigned long &sent, unsigned long &start);
+		boolean calibrate_echo(unsigned long start, unsigned long &end);
+		static unsigned long convert_us(unsigned int length);
+#if ULTRAPING_URM37_ENABLED == false
+		static uint32_t sound_scale(unsigned int speed, uint32_t length);
+#endif
+		void multi_begin(multi_state &m, unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance);
+		boolean multi_first(multi_state &m);
+		boolean multi_second(multi_state &m, unsigned long second_start, unsigned long second_end_time);
+		boolean multi_room(multi_state &m);
+		boolean multi_early(multi_state &m);
+		boolean multi_reuse(multi_state &m);
+		boolean multi_ghost(multi_state &m, uint8_t pings, unsigned long from, unsigned long until);
+		unsigned int multi_next(multi_state &m, unsigned int offset);
+		void settle(unsigned long since);
+		void settle_learn(boolean early);
+		static void (*_yieldFunc)(void);
+		static unsigned int _yieldBudget; // uS the yield function may take.
 #if ULTRAPING_TIMER_ENABLED == true
-		boolean ping_trigger_timer(unsigned int trigger_delay);
-		boolean ping_wait_timer();
-		static void timer_setup();
-		static void timer_ms_cntdwn();
+		struct timer_slot {              // A function the timer interrupt calls every period.
+			const void *owner;           // Sensor, UltraPingArray, timer_us or timer_ms.
+			void (*func)(void);          // NULL when the slot is free.
+			unsigned long period;        // uS between calls.
+			long remaining;              // uS until the next call.
+		};
+
+		boolean multi_timer_done(unsigned int hits);
+		static boolean timer_attach(const void *owner, unsigned long period, void (*func)(void));
+		static boolean timer_free(const void *owner);
+		static void timer_period(const void *owner, unsigned long period);
+		static void timer_detach(const void *owner);
+		static void timer_start();
+		static timer_slot _timerSlot[ULTRAPING_TIMER_SLOTS];
+		static volatile uint8_t _timerSlots; // Slots up to the last one in use.
+		static unsigned int _timerTick;      // uS between timer interrupts, 0 when stopped.
+		static multi_state _multiTimer;
+		static volatile uint8_t _multiTimerState;
+#endif
+#if ULTRAPING_EDGE_ENABLED == true
+		void edge_done(unsigned long echoTime);
+		static void edge_stop();
+		static UltraPing * volatile _edgeSonar;
+		static void (*_edgeFunc)(void);
+		static volatile unsigned long _edgeStart;
+		static volatile uint8_t _edgeState;
+	#if ULTRAPING_EDGE_ICP1 == true
+		static volatile unsigned long _edgeStartUs;
+	#endif
 #endif
 #if ULTRAPING_DO_BITWISE == true
 		uint8_t _triggerBit;
@@ -316,13 +695,328 @@ class UltraPing {
 		volatile uint8_t *_triggerOutput;
 		volatile uint8_t *_echoInput;
 		volatile uint8_t *_triggerMode;
+	#if ULTRAPING_EDGE_ENABLED == true && ULTRAPING_EDGE_ICP1 == false
+		uint8_t _echoPin; // Needed for attachInterrupt().
+	#endif
 #else
 		uint8_t _triggerPin;
 		uint8_t _echoPin;
 #endif
 		unsigned int _maxEchoTime;
+		static uint32_t _lengthScale;    // Length unit per uS, times 2^24.
+		static uint32_t _mmScale;        // mm per uS, times 2^24.
+		static uint16_t _roundtripTime;  // uS per length unit round-trip, times 256.
+		uint8_t _roundBudget;
+		const unsigned int *_probes;
+		uint8_t _probeCount;
+		uint8_t _multiReuse;             // Rounds that may share one first ping, 0 or 1 = every round measures it.
+		unsigned int _settleTime;
 		unsigned long _max_time;
+		ultraping_ticks _startTicks;     // Ticks when the last blocking ping started.
+		ultraping_ticks _maxEchoTicks;   // _maxEchoTime in ticks.
+		ultraping_ticks _startLimit;     // Ticks to wait for a ping to start, 0 if that's too long for the ticks and micros() is used.
+		unsigned int _startDelay;        // Sensor profile, see ULTRAPING_PROFILE.
+		unsigned int _deadTime;
+		unsigned int _minSeparation;
+		boolean _activeLow;
+		unsigned int _latencyMin;        // uS from trigger to ping start measured by calibrate(), ping_multi starts from them.
+		unsigned int _latencyMax;
+#if ULTRAPING_TIMER_ENABLED == true || ULTRAPING_EDGE_ENABLED == true
+		void publish(unsigned long result, unsigned int echo, uint8_t hits);
+		UltraPingQueueBase *_queue;
+#endif
+#if ULTRAPING_STATS_ENABLED == true
+		UltraPingStats _stats;
+#endif
+#if ULTRAPING_TRACE_ENABLED == true
+		void trace_event(uint8_t type, unsigned long value);
+		UltraPingTraceBase *_trace;
+#endif
+#if ULTRAPING_HEALTH_ENABLED == true
+		void health_report(uint8_t status);
+		boolean health_skip();
+		uint8_t _health;                 // ULTRAPING_HEALTH_ of the last ping.
+		uint8_t _healthFails;            // Failed pings in a row, quarantined at HEALTH_FAILS.
+		uint8_t _healthBackoff;          // Failed probes in quarantine, doublings of the probe interval.
+		unsigned long _healthProbe;      // millis() when quarantined, or the last probe failed.
+#endif
 };
 
 
+// -------------------------------------------------------------------------------------
+// Input and output methods (Bitwise or normal)
+// All of them are marked inline, so compiler will probably inline them at compile-time.
+// Defined in the header, so UltraPingArray and friends can inline them too.
+// -------------------------------------------------------------------------------------
+
+inline boolean UltraPing::readEcho() {
+	#if ULTRAPING_DO_BITWISE == true
+		return *_echoInput & _echoBit;
+	#else
+		return digitalRead(_echoPin);
+	#endif
+}
+
+inline boolean UltraPing::echoActive() {
+	return readEcho() != _activeLow;
+}
+
+inline void UltraPing::setTriggerActive() {
+	#if ULTRAPING_DO_BITWISE == true
+		*_triggerOutput |= _triggerBit;    // Set trigger pin high, this tells the sensor to send out a ping.
+	#else
+		digitalWrite(_triggerPin, HIGH);   // Set trigger pin high, this tells the sensor to send out a ping.
+	#endif
+}
+inline void UltraPing::setTriggerNotActive() {
+	#if ULTRAPING_DO_BITWISE == true
+		*_triggerOutput &= ~_triggerBit;   // Set the trigger pin low.
+	#else
+		digitalWrite(_triggerPin, LOW);    // Set the trigger pin low.
+	#endif
+}
+#if ULTRAPING_ONE_PIN_ENABLED == true
+	inline void UltraPing::onePinSetTriggerMode() {
+		#if ULTRAPING_DO_BITWISE == true
+			*_triggerMode |= _triggerBit;  // Set trigger pin to output.
+		#else
+			pinMode(_triggerPin, OUTPUT); // Set trigger pin to output.
+		#endif
+	}
+	inline void UltraPing::onePinSetEchoMode() {
+		#if ULTRAPING_DO_BITWISE == true
+			*_triggerMode &= ~_triggerBit; // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
+		#else
+			pinMode(_triggerPin, INPUT);  // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
+		#endif
+	}
+#endif
+
+// -------------------------------------------------------------------------------------
+// Pin interface for the ping loops. UltraPing uses its pins from the object at run-time,
+// UltraPingT (see UltraPingT.h) instantiates the same loops with pins fixed at compile-time.
+// -------------------------------------------------------------------------------------
+
+struct UltraPingRuntimePins {
+	static inline boolean echoActive(UltraPing &sonar) { return sonar.echoActive(); }
+	static inline void setTriggerActive(UltraPing &sonar) { sonar.setTriggerActive(); }
+	static inline void setTriggerNotActive(UltraPing &sonar) { sonar.setTriggerNotActive(); }
+#if ULTRAPING_ONE_PIN_ENABLED == true
+	static inline void onePinSetTriggerMode(UltraPing &sonar) { sonar.onePinSetTriggerMode(); }
+	static inline void onePinSetEchoMode(UltraPing &sonar) { sonar.onePinSetEchoMode(); }
+#endif
+};
+
+
+// -------------------------------------------------------------------------------------
+// Ping loops, templated on the pin interface.
+// -------------------------------------------------------------------------------------
+
+// ping, ping_multi and ping_median of UltraPing and UltraPingT, recorded with set_trace() as one call (the pings of ping_median aren't calls of their own).
+template <class PINS> unsigned int UltraPing::ping_traced(unsigned int max_distance) {
+	ULTRAPING_TRACE(ULTRAPING_TRACE_PING, max_distance);
+	unsigned int echoTime = ping_pins<PINS>(max_distance);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_RESULT, echoTime);
+	return echoTime;
+}
+
+template <class PINS> unsigned int UltraPing::ping_multi_traced(unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance) {
+	ULTRAPING_TRACE(ULTRAPING_TRACE_MULTI, maximum_hits);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_ARG, threshold_distance);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_ARG, max_distance);
+	unsigned int hits = ping_multi_pins<PINS>(hit, maximum_hits, threshold_distance, max_distance);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_RESULT, hits);
+	for (unsigned int i = 0; i < hits; i++) ULTRAPING_TRACE(ULTRAPING_TRACE_HIT, hit[i]);
+	return hits;
+}
+
+template <class PINS> unsigned long UltraPing::ping_median_traced(uint8_t it, unsigned int max_distance) {
+	ULTRAPING_TRACE(ULTRAPING_TRACE_MEDIAN, it);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_ARG, max_distance);
+	unsigned long echoTime = ping_median_pins<PINS>(it, max_distance);
+	ULTRAPING_TRACE(ULTRAPING_TRACE_RESULT, echoTime);
+	return echoTime;
+}
+
+template <class PINS> unsigned int UltraPing::ping_pins(unsigned int max_distance) {
+	ULTRAPING_STAT_BUSY();
+	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
+
+	if (!ping_trigger_pins<PINS>()) return  ULTRAPING_NO_ECHO; // Trigger a ping, if it returns false, return NO_ECHO to the calling function.
+
+	while (PINS::echoActive(*this)) {                // Wait for the ping echo.
+		if (ULTRAPING_ELAPSED(_startTicks) > _maxEchoTicks) { // Stop the loop and return NO_ECHO (false) if we're beyond the set maximum distance.
+			ULTRAPING_STAT(echo_timeouts);
+			ULTRAPING_HEALTH(ULTRAPING_HEALTH_NO_ECHO);
+			ULTRAPING_TRACE(ULTRAPING_TRACE_NO_ECHO, 0);
+			return ULTRAPING_NO_ECHO;
+		}
+	}
+
+	unsigned int echoTime = ULTRAPING_TICKS_2_US(ULTRAPING_ELAPSED(_startTicks));
+	ULTRAPING_TRACE(ULTRAPING_TRACE_ECHO, echoTime);
+	return echoTime - ULTRAPING_PING_OVERHEAD; // Calculate ping time, include overhead.
+}
+
+template <class PINS> unsigned int UltraPing::ping_multi_pins(unsigned int hit[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance) {
+	ULTRAPING_STAT_BUSY();
+	if (max_distance > 0) set_max_distance(max_distance); // Call function to set a new max sensor distance.
+
+	multi_state m;
+	multi_begin(m, hit, maximum_hits, threshold_distance);
+	ultraping_ticks first = 0;                   // All times in the round are measured in ticks from here, and converted to micros() time from first_start.
+	boolean reuse = false;                       // Round reuses the first ping of the last round, see set_multi_reuse.
+	while(m.hits < maximum_hits) {
+		if (!reuse) {
+			if (!ping_trigger_pins<PINS>()) return 0; // Trigger a ping, if it returns false, return 0 hits (Something wrong)
+			first = _startTicks;
+			m.first_max_time = _max_time; //The max_time from first ping, is also used later as max for second ping.
+			m.first_start = (_max_time - _maxEchoTime) - ULTRAPING_PING_OVERHEAD;
+
+			while (PINS::echoActive(*this)) {                // Wait for the ping echo.
+				if (ULTRAPING_ELAPSED(first) > _maxEchoTicks) { // Stop the loop and return hits so far.
+					ULTRAPING_STAT(echo_timeouts);
+					ULTRAPING_HEALTH(ULTRAPING_HEALTH_NO_ECHO);
+					ULTRAPING_TRACE(ULTRAPING_TRACE_NO_ECHO, 0);
+					return m.hits;
+				}
+			}
+			m.first_length = ULTRAPING_TICKS_2_US(ULTRAPING_ELAPSED(first)) + ULTRAPING_PING_OVERHEAD; // Calculate ping time, for first echo.
+			ULTRAPING_TRACE(ULTRAPING_TRACE_ECHO, m.first_length - ULTRAPING_PING_OVERHEAD);
+			if (multi_early(m)) { // Echo left from last round, wait longer and redo the round.
+				settle(m.first_start);
+				continue;
+			}
+			if (!multi_first(m)) return m.hits;
+		}
+		ULTRAPING_TRACE(ULTRAPING_TRACE_OFFSET, m.offset);
+
+		// #######################################################################################################################################################
+		unsigned long offset = (unsigned long) max(m.offset, m.last_end + _deadTime) * ULTRAPING_TICKS_PER_US; // Not before the sensor takes a trigger again.
+		while ((unsigned long) ULTRAPING_ELAPSED(first) + ULTRAPING_PING_OVERHEAD * ULTRAPING_TICKS_PER_US < offset) {//Wait before we start next ping, to let secondary echos from first ping return before first echo from second ping.
+			if (_yieldFunc && (unsigned long) ULTRAPING_ELAPSED(first) + (ULTRAPING_PING_OVERHEAD + (unsigned long) _yieldBudget) * ULTRAPING_TICKS_PER_US < offset) { // Echo pin isn't read here, time to spare goes to the sketch.
+				ULTRAPING_STAT(yields);
+				_yieldFunc();
+			}
+		}
+		// #######################################################################################################################################################
+
+		if (!ping_trigger_pins<PINS>()) return 0; // Trigger a second ping, if it returns false, return 0 hits (Something wrong)
+		while (PINS::echoActive(*this)) {                // Wait for the ping echo.
+			if (ULTRAPING_ELAPSED(first) > _maxEchoTicks) { // No more echo within range from first ping, return result
+				ULTRAPING_STAT(echo_timeouts);
+				ULTRAPING_TRACE(ULTRAPING_TRACE_NO_ECHO, 0);
+				return m.hits;
+			}
+		}
+		unsigned long second_end = m.first_start + ULTRAPING_TICKS_2_US(ULTRAPING_ELAPSED(first)) + ULTRAPING_PING_OVERHEAD;
+		unsigned long second_start = m.first_start + ULTRAPING_TICKS_2_US((ultraping_ticks) (_startTicks - first));
+		ULTRAPING_TRACE(ULTRAPING_TRACE_ECHO, second_end - second_start - ULTRAPING_PING_OVERHEAD);
+		if (!multi_second(m, second_start, second_end)) return m.hits; // Done, no more tries.
+		reuse = multi_reuse(m);
+		if (!reuse) settle(second_start); // Wait until all echos ebb away
+	}
+	return m.hits; //Maximum number of hits found, return those found so far
+}
+
+template <class PINS> unsigned long UltraPing::ping_median_pins(uint8_t it, unsigned int max_distance) {
+	unsigned int uS[it], last, previous = ULTRAPING_NO_ECHO;
+	uint8_t j, i = 0;
+	unsigned long t;
+	uS[0] = ULTRAPING_NO_ECHO;
+
+	while (i < it) {
+		if (ULTRAPING_HEALTH_SKIP()) { // Quarantined, median of the pings so far.
+			it = i;
+			break;
+		}
+		t = micros();                  // Start ping timestamp.
+		last = ping_pins<PINS>(max_distance); // Send ping.
+
+		if (last != ULTRAPING_NO_ECHO && previous != ULTRAPING_NO_ECHO && last < ULTRAPING_THREE_QUARTERS(previous) && settle_time() < ULTRAPING_PING_MEDIAN_DELAY) {
+			settle_learn(true);        // Much shorter than last ping, probably an echo from it. Wait longer and ping again.
+			ULTRAPING_STAT(early_echos);
+		} else if (last != ULTRAPING_NO_ECHO) {  // Ping in range, include as part of median.
+			settle_learn(false);
+			previous = last;
+			if (i > 0) {               // Don't start sort till second ping.
+				for (j = i; j > 0 && uS[j - 1] < last; j--) // Insertion sort loop.
+					uS[j] = uS[j - 1];                      // Shift ping array to correct position for sort insertion.
+			} else j = 0;              // First ping is sort starting point.
+			uS[j] = last;              // Add last ping to array in sorted position.
+			i++;                       // Move to next ping.
+		} else it--;                   // Ping out of range, skip and don't include as part of median.
+
+		if (i < it && !ULTRAPING_HEALTH_QUARANTINED()) { // Delay between pings, unless the next one won't be sent.
+			ULTRAPING_STAT_BUSY();
+			settle(t);
+		}
+
+	}
+	return (uS[it >> 1]); // Return the ping distance median.
+}
+
+template <class PINS> boolean UltraPing::ping_trigger_pins() {
+	ULTRAPING_TICKS_BEGIN();
+	if (ULTRAPING_HEALTH_SKIP()) return false;    // Quarantined, and not time to probe it yet.
+	if (!ping_send_pins<PINS>()) {                // Previous ping hasn't finished, abort.
+		ULTRAPING_HEALTH(ULTRAPING_HEALTH_STUCK);
+		return false;
+	}
+	ultraping_ticks sent = ULTRAPING_TICKS();
+	unsigned long sentUs = ULTRAPING_FAST_CLOCK == true ? micros() : (unsigned long) sent; // Ticks are micros() without FAST_CLOCK.
+	while (!PINS::echoActive(*this)) { // Wait for ping to start.
+		if (_startLimit ? ULTRAPING_ELAPSED(sent) > _startLimit : micros() - sentUs > start_wait()) { // Took too long to start, abort.
+			ULTRAPING_STAT(start_timeouts);
+			ULTRAPING_HEALTH(ULTRAPING_HEALTH_NO_START);
+			ULTRAPING_TRACE(ULTRAPING_TRACE_NO_START, 0);
+			return false;
+		}
+	}
+	_startTicks = ULTRAPING_TICKS();              // Timestamp first.
+	ULTRAPING_HEALTH(ULTRAPING_HEALTH_OK);
+	_max_time = micros() + _maxEchoTime;          // Ping started, set the time-out (as ping_started does, for ping_timer).
+	ULTRAPING_TRACE(ULTRAPING_TRACE_START, ULTRAPING_TICKS_2_US((ultraping_ticks) (_startTicks - sent)));
+	return true;                       // Ping started successfully.
+}
+
+
+template <class PINS> boolean UltraPing::ping_send_pins() { // Send trigger pulse without waiting for the ping to start.
+	#if ULTRAPING_ONE_PIN_ENABLED == true
+		PINS::onePinSetTriggerMode(*this);
+	#endif
+
+	PINS::setTriggerNotActive(*this);  // Should already be low, but this will make sure it is.
+	delayMicroseconds(4);              // Wait for pin to go low.
+	PINS::setTriggerActive(*this);     // Set trigger pin high, this tells the sensor to send out a ping.
+	delayMicroseconds(10);             // Wait long enough for the sensor to realize the trigger pin is high. Sensor specs say to wait 10uS.
+	PINS::setTriggerNotActive(*this);  // Set trigger pin back to low.
+
+	#if ULTRAPING_ONE_PIN_ENABLED == true
+		PINS::onePinSetEchoMode(*this);    // Set trigger pin to input (when using one Arduino pin, this is technically setting the echo pin to input as both are tied to the same Arduino pin).
+	#endif
+
+	if (PINS::echoActive(*this)) {                  // Previous ping hasn't finished, abort.
+		ULTRAPING_STAT(trigger_aborts);
+		ULTRAPING_TRACE(ULTRAPING_TRACE_ABORT, 0);
+		return false;
+	}
+	ULTRAPING_STAT(triggers);
+	_max_time = micros() + start_wait(); // Maximum time we'll wait for ping to start (most sensors are <450uS, the SRF06 can take up to 34,300uS!)
+	ULTRAPING_TRACE(ULTRAPING_TRACE_TRIGGER, _max_time - start_wait()); // micros() of the trigger.
+	return true;                                                      // Trigger sent, use ping_started() to see when ping starts.
+}
+
+
+template <class PINS> inline boolean UltraPing::ping_started_pins() { // Check if a ping sent with ping_send() has started.
+	if (!PINS::echoActive(*this)) return false; // Ping hasn't started yet.
+	_max_time = micros() + _maxEchoTime;               // Ping started, set the time-out.
+	return true;
+}
+
+inline boolean UltraPing::ping_started() { // Check if a ping sent with ping_send() has started.
+	return ping_started_pins<UltraPingRuntimePins>();
+}
+
+
 #endif
@@ -0,0 +1,186 @@
+// ---------------------------------------------------------------------------
+// UltraPingArray, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingArray.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingArray.h>
+
+#if ULTRAPING_TIMER_ENABLED == true
+
+// Sensor states
+#define ULTRAPING_ARRAY_WAIT  0 // Not pinged yet this cycle.
+#define ULTRAPING_ARRAY_START 1 // Trigger sent, waiting for ping to start.
+#define ULTRAPING_ARRAY_ECHO  2 // Ping started, waiting for echo.
+#define ULTRAPING_ARRAY_DECAY 3 // Echo received, waiting for echos to decay.
+#define ULTRAPING_ARRAY_DONE  4 // Pinged this cycle.
+
+UltraPingArrayBase *UltraPingArrayBase::_running = NULL;
+
+
+// ---------------------------------------------------------------------------
+// UltraPingArray constructor
+// ---------------------------------------------------------------------------
+
+UltraPingArrayBase::UltraPingArrayBase(UltraPing sonar[], UltraPingArraySensor sensor[], uint8_t sonar_num) {
+	_sonar = sonar;
+	_sensor = sensor;
+	_sonarNum = min(sonar_num, ULTRAPING_ARRAY_MAX_SENSORS);
+	_cycleFunc = NULL;
+	_cycleTime = 0;
+	decay_factor = ULTRAPING_ARRAY_DECAY_FACTOR;
+	max_slot = ULTRAPING_ARRAY_MAX_SLOT;
+	jitter = ULTRAPING_ARRAY_JITTER;
+	tolerance = ULTRAPING_ARRAY_TOLERANCE;
+
+	for (uint8_t i = 0; i < _sonarNum; i++) {
+		set_cross_talk(i, 0xFFFF); // Until told otherwise, all sensors can hear each other.
+		_sensor[i].state = ULTRAPING_ARRAY_DONE;
+		_sensor[i].result = _sensor[i].previous = ULTRAPING_NO_ECHO;
+		_sensor[i].sequence = 0xACE1 ^ (i * 0x2B5D); // Own sequence per sensor, never 0.
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingArray methods
+// ---------------------------------------------------------------------------
+
+void UltraPingArrayBase::set_cross_talk(uint8_t sensor, uint16_t mask) {
+	if (sensor < _sonarNum) _sensor[sensor].cross_talk = mask & ~(1U << sensor); // A sensor always hears itself, that is not cross-talk.
+}
+
+
+void UltraPingArrayBase::start(void (*cycleFunc)(void)) {
+	stop();
+	_cycleFunc = cycleFunc;
+	_cycleStart = micros();
+	for (uint8_t i = 0; i < _sonarNum; i++) wait(i, _cycleStart);
+	_running = this;
+	UltraPing::timer_attach(this, ULTRAPING_ECHO_TIMER_FREQ, check_array); // Check sensors every ECHO_TIMER_FREQ uS, in a timer slot of its own.
+}
+
+
+void UltraPingArrayBase::stop() {
+	if (_running) UltraPing::timer_detach(_running);
+	_running = NULL;
+}
+
+
+unsigned int UltraPingArrayBase::result(uint8_t sensor) {
+	return sensor < _sonarNum ? _sensor[sensor].result : ULTRAPING_NO_ECHO;
+}
+
+
+unsigned long UltraPingArrayBase::cycle_time() {
+	return _cycleTime;
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingArray support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+void UltraPingArrayBase::check_array() { // Called from the timer interrupt.
+	if (_running) _running->check();
+}
+
+
+void UltraPingArrayBase::check() {
+	unsigned long now = micros();
+	uint16_t active = 0;
+	boolean done = true;
+
+	for (uint8_t i = 0; i < _sonarNum; i++) { // Advance sensors that are pinging.
+		UltraPing &sonar = _sonar[i];
+		UltraPingArraySensor &sensor = _sensor[i];
+		switch (sensor.state) {
+			case ULTRAPING_ARRAY_START:
+				if (sonar.ping_started()) {
+					sensor.start = (sonar._max_time - sonar._maxEchoTime) - ULTRAPING_PING_TIMER_OVERHEAD;
+					sensor.state = ULTRAPING_ARRAY_ECHO;
+					ULTRAPING_HEALTH_OF(sonar, ULTRAPING_HEALTH_OK);
+				} else if (now > sonar._max_time) { // Took too long to start, give up and free the slot.
+					ULTRAPING_STAT_OF(sonar, start_timeouts);
+					ULTRAPING_HEALTH_OF(sonar, ULTRAPING_HEALTH_NO_START);
+					sensor.slot_end = now;
+					sensor.state = ULTRAPING_ARRAY_DECAY;
+				}
+				break;
+			case ULTRAPING_ARRAY_ECHO:
+				if (!sonar.echoActive()) { // Ping echo received.
+					sensor.result = micros() - sensor.start;
+					sensor.slot_end = sensor.start + min((unsigned long) decay_factor * sensor.result, (unsigned long) max_slot);
+					sensor.state = ULTRAPING_ARRAY_DECAY;
+				} else if (now > sonar._max_time) { // No echo within the set distance limit.
+					ULTRAPING_STAT_OF(sonar, echo_timeouts);
+					ULTRAPING_HEALTH_OF(sonar, ULTRAPING_HEALTH_NO_ECHO);
+					sensor.slot_end = sensor.start + max_slot;
+					sensor.state = ULTRAPING_ARRAY_DECAY;
+				}
+				break;
+			case ULTRAPING_ARRAY_DECAY:
+				if (now >= sensor.slot_end) {
+					if (jitter) accept(sensor);
+					sensor.state = ULTRAPING_ARRAY_DONE;
+				}
+				break;
+		}
+		if (sensor.state != ULTRAPING_ARRAY_DONE) {
+			done = false;
+			if (sensor.state != ULTRAPING_ARRAY_WAIT) active |= (1U << i);
+		}
+	}
+
+	if (done) { // All sensors pinged, cycle complete.
+		_cycleTime = now - _cycleStart;
+		_cycleStart = now;
+		if (_cycleFunc) _cycleFunc();
+		for (uint8_t i = 0; i < _sonarNum; i++) wait(i, now);
+		return;
+	}
+
+	for (uint8_t i = 0; i < _sonarNum; i++) { // Start sensors that can't hear, or be heard by, active sensors.
+		UltraPingArraySensor &sensor = _sensor[i];
+		if (sensor.state != ULTRAPING_ARRAY_WAIT) continue;
+		if (jitter ? now < sensor.slot_end : conflicts(i, active)) continue; // Not its time yet, or it would hear or be heard.
+		sensor.result = ULTRAPING_NO_ECHO;
+		if (ULTRAPING_HEALTH_SKIP_OF(_sonar[i])) {
+			sensor.state = ULTRAPING_ARRAY_DONE; // Quarantined, skip this cycle.
+		} else if (_sonar[i].ping_send()) {
+			sensor.state = ULTRAPING_ARRAY_START;
+			active |= (1U << i);
+		} else {
+			ULTRAPING_HEALTH_OF(_sonar[i], ULTRAPING_HEALTH_STUCK);
+			sensor.state = ULTRAPING_ARRAY_DONE; // Previous ping hasn't finished, skip this cycle.
+		}
+	}
+}
+
+
+boolean UltraPingArrayBase::conflicts(uint8_t sensor, uint16_t active) {
+	if (_sensor[sensor].cross_talk & active) return true;     // An active sensor would hear this sensor.
+	for (uint8_t i = 0; i < _sonarNum; i++)
+		if ((active & (1U << i)) && (_sensor[i].cross_talk & (1U << sensor))) return true; // This sensor would hear an active sensor.
+	return false;
+}
+
+
+void UltraPingArrayBase::wait(uint8_t sensor, unsigned long now) { // Sensor waits for its turn in the next cycle.
+	UltraPingArraySensor &s = _sensor[sensor];
+	s.state = ULTRAPING_ARRAY_WAIT;
+	if (!jitter) return;
+	s.sequence = (s.sequence >> 1) ^ (-(s.sequence & 1) & 0xB400); // 16-bit Galois LFSR, period 65535.
+	s.slot_end = now + (((unsigned long) s.sequence * jitter + s.sequence) >> 16); // Trigger time, sequence scaled to 0 - jitter (16x16 bit multiply, no division in the interrupt).
+}
+
+
+void UltraPingArrayBase::accept(UltraPingArraySensor &sensor) { // With jitter, keep the reading only if it's where the previous one was.
+	unsigned int reading = sensor.result;
+	unsigned int difference = reading > sensor.previous ? reading - sensor.previous : sensor.previous - reading;
+	if (difference > tolerance) sensor.result = ULTRAPING_NO_ECHO; // Moved with the random wait, a neighbour's ping.
+	sensor.previous = reading;
+}
+
+#endif
@@ -0,0 +1,107 @@
+// ---------------------------------------------------------------------------
+// UltraPingArray - Scheduler for many UltraPing sensors
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// The NewPing15Sensors example pings one sensor every 33ms, so a cycle of 15
+// sensors takes 495ms. Most of that time is spent waiting for nothing:
+// sensors that can't hear each other could ping at the same time, and a
+// sensor with a close echo doesn't need a full 33ms slot.
+// UltraPingArray pings all sensors from the timer interrupt. A sensor is
+// started as soon as no sensor that can hear it (or that it can hear) is
+// active, and its slot ends when its echo has arrived and decayed
+// (decay_factor times the echo time), or after max_slot uS.
+//
+// Sensors that can hear each other can also ping at the same time, with
+// jitter set. Every sensor then waits a pseudo-random time (its own sequence,
+// up to jitter uS) before its trigger. A real echo comes back the same time
+// after the sensor's own trigger every cycle, while a neighbour's ping moves
+// around with the difference of their random waits. A reading is only
+// accepted if it is within tolerance uS of the sensor's previous reading,
+// otherwise the result is NO_ECHO for that cycle.
+//
+// CONSTRUCTOR:
+//   UltraPingArray<SONAR_NUM> sonars(sonar[])
+//     sonar[] - Array of SONAR_NUM UltraPing objects, max 16 sensors.
+//
+// METHODS:
+//   sonars.set_cross_talk(sensor, mask) - Bitmask of sensors that can hear sensor's pings. Default=all other sensors (one sensor at a time).
+//   sonars.start(function) - Start pinging, function is called from the timer interrupt every time all sensors are pinged.
+//   sonars.stop() - Stop pinging.
+//   sonars.result(sensor) - Echo time in uS from the last cycle (NO_ECHO if none).
+//   sonars.cycle_time() - Time in uS of the last complete cycle.
+//   sonars.decay_factor - Slot ends at decay_factor times the echo time after ping start. Default=3
+//   sonars.max_slot - Maximum slot in uS, also used when there's no echo. Default=29000
+//   sonars.jitter - Maximum random wait in uS before each trigger, all sensors ping at once and cross-talk masks are not used. 0 is off. Default=0
+//   sonars.tolerance - With jitter, max uS between two readings in a row for them to be accepted. Default=100
+//
+// UltraPingArray takes a slot on the same timer as ping_timer, timer_us and
+// timer_ms, so they can run beside it. Only one UltraPingArray can run at a
+// time.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingArray_h
+#define UltraPingArray_h
+
+#include <UltraPing.h>
+
+#if ULTRAPING_TIMER_ENABLED == true
+
+#define ULTRAPING_ARRAY_MAX_SENSORS 16     // Cross-talk masks are 16 bits.
+#define ULTRAPING_ARRAY_DECAY_FACTOR 3     // Default slot, times the echo time. Default=3
+#define ULTRAPING_ARRAY_MAX_SLOT ULTRAPING_PING_MEDIAN_DELAY // Default maximum slot in uS. Default=29000
+#define ULTRAPING_ARRAY_JITTER 0           // Default maximum random wait before trigger in uS, 0 = off. Default=0
+#define ULTRAPING_ARRAY_TOLERANCE 100      // Default uS between readings in a row to accept them, with jitter. Default=100
+
+struct UltraPingArraySensor {
+	uint16_t cross_talk;       // Sensors that can hear this sensor's pings.
+	uint8_t state;
+	unsigned int result;       // uS, echo time.
+	unsigned int previous;     // uS, echo time of the previous reading, accepted or not (jitter only).
+	uint16_t sequence;         // Pseudo-random sequence for the trigger wait (jitter only).
+	unsigned long start;       // micros() when ping started.
+	unsigned long slot_end;    // micros() when echos have decayed, or when to trigger (jitter only).
+};
+
+class UltraPingArrayBase {
+	public:
+		void set_cross_talk(uint8_t sensor, uint16_t mask);
+		void start(void (*cycleFunc)(void));
+		void stop();
+		unsigned int result(uint8_t sensor);
+		unsigned long cycle_time();
+		uint8_t decay_factor;
+		unsigned int max_slot;
+		unsigned int jitter;
+		unsigned int tolerance;
+	protected:
+		UltraPingArrayBase(UltraPing sonar[], UltraPingArraySensor sensor[], uint8_t sonar_num);
+	private:
+		static void check_array();
+		void check();
+		boolean conflicts(uint8_t sensor, uint16_t active);
+		void wait(uint8_t sensor, unsigned long now);
+		void accept(UltraPingArraySensor &sensor);
+
+		UltraPing *_sonar;
+		UltraPingArraySensor *_sensor;
+		uint8_t _sonarNum;
+		void (*_cycleFunc)(void);
+		unsigned long _cycleStart;
+		unsigned long _cycleTime;
+		static UltraPingArrayBase *_running;
+};
+
+template <uint8_t SONAR_NUM> class UltraPingArray : public UltraPingArrayBase {
+	public:
+		UltraPingArray(UltraPing sonar[]) : UltraPingArrayBase(sonar, _sensors, SONAR_NUM) {}
+	private:
+		UltraPingArraySensor _sensors[SONAR_NUM];
+};
+
+#endif
+
+#endif
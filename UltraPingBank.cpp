@@ -0,0 +1,157 @@
+// ---------------------------------------------------------------------------
+// UltraPingBank, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingBank.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingBank.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingBank constructor
+// ---------------------------------------------------------------------------
+
+UltraPingBankBase::UltraPingBankBase(UltraPing sonar[], UltraPingBankSensor sensor[], uint8_t sonar_num) {
+	_sonar = sonar;
+	_sensor = sensor;
+	_sonarNum = min(sonar_num, ULTRAPING_BANK_MAX_SENSORS);
+	_activeLow = 0;
+
+#if ULTRAPING_DO_BITWISE == true
+	uint8_t used = 0;
+	_echoInput = _sonarNum ? _sonar[0]._echoInput : NULL;
+	for (uint8_t i = 0; i < _sonarNum; i++) { // One port read is enough if all echo pins are different bits of the same port.
+		if (_sonar[i]._echoInput != _echoInput || (used & _sonar[i]._echoBit)) _echoInput = NULL;
+		used |= _sonar[i]._echoBit;
+	}
+#endif
+	for (uint8_t i = 0; i < _sonarNum; i++) {
+#if ULTRAPING_DO_BITWISE == true
+		_sensor[i].bit = _echoInput ? _sonar[i]._echoBit : (1U << i);
+#else
+		_sensor[i].bit = 1U << i;
+#endif
+		_sensor[i].result = ULTRAPING_NO_ECHO;
+		if (_sonar[i]._activeLow) _activeLow |= _sensor[i].bit;
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingBank methods
+// ---------------------------------------------------------------------------
+
+uint8_t UltraPingBankBase::ping(unsigned int max_distance) {
+	for (uint8_t i = 0; i < _sonarNum; i++) {
+		if (max_distance > 0) _sonar[i].set_max_distance(max_distance); // Call function to set a new max sensor distance.
+		_sensor[i].result = ULTRAPING_NO_ECHO;
+	}
+
+	uint16_t pending = trigger(), started = 0; // Sensors still pinging, and those whose ping has started.
+	unsigned long now = micros(), next = now;
+	for (uint8_t i = 0; i < _sonarNum; i++) _sensor[i].deadline = now + _sonar[i].start_wait(); // Maximum time we'll wait for ping to start.
+	uint8_t echos = 0;
+
+	while (pending) {
+		uint16_t echo = sample();                  // All echo pins at once.
+		now = micros();
+		uint16_t rose = echo & pending & ~started; // Ping started.
+		uint16_t fell = ~echo & started;           // Ping echo received.
+		if (!rose && !fell && now <= next) continue; // Nothing happened, the usual case.
+
+		next = 0xFFFFFFFF;
+		for (uint8_t i = 0; i < _sonarNum; i++) {
+			UltraPingBankSensor &sensor = _sensor[i];
+			if (!(pending & sensor.bit)) continue;
+			if (rose & sensor.bit) {
+				sensor.start = now;
+				sensor.deadline = now + _sonar[i]._maxEchoTime; // Ping started, set the time-out.
+				started |= sensor.bit;
+				ULTRAPING_HEALTH_OF(_sonar[i], ULTRAPING_HEALTH_OK);
+			} else if (fell & sensor.bit) {
+				sensor.result = now - sensor.start - ULTRAPING_PING_OVERHEAD; // Calculate ping time, include overhead.
+				started &= ~sensor.bit;
+				pending &= ~sensor.bit;
+				echos++;
+				continue;
+			} else if (now > sensor.deadline) { // Took too long to start, or no echo within the set distance limit.
+				if (started & sensor.bit) {
+					ULTRAPING_STAT_OF(_sonar[i], echo_timeouts);
+					ULTRAPING_HEALTH_OF(_sonar[i], ULTRAPING_HEALTH_NO_ECHO);
+				} else {
+					ULTRAPING_STAT_OF(_sonar[i], start_timeouts);
+					ULTRAPING_HEALTH_OF(_sonar[i], ULTRAPING_HEALTH_NO_START);
+				}
+				started &= ~sensor.bit;
+				pending &= ~sensor.bit;
+				continue;
+			}
+			next = min(next, sensor.deadline);
+		}
+	}
+	return echos;
+}
+
+
+unsigned int UltraPingBankBase::result(uint8_t sensor) {
+	return sensor < _sonarNum ? _sensor[sensor].result : ULTRAPING_NO_ECHO;
+}
+
+
+boolean UltraPingBankBase::shared_port() {
+#if ULTRAPING_DO_BITWISE == true
+	return _echoInput != NULL;
+#else
+	return false;
+#endif
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingBank support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+inline uint16_t UltraPingBankBase::sample() { // Echo pins, bit set if active.
+	uint16_t echo = 0;
+#if ULTRAPING_DO_BITWISE == true
+	if (_echoInput) echo = *_echoInput; // All pins in one read.
+	else
+#endif
+		for (uint8_t i = 0; i < _sonarNum; i++)
+			if (_sonar[i].readEcho()) echo |= (1U << i);
+	return echo ^ _activeLow; // Some sensors' echo is active low.
+}
+
+
+uint16_t UltraPingBankBase::trigger() { // Send one trigger pulse to all sensors, returns the sensors triggered.
+	uint8_t i;
+	for (i = 0; i < _sonarNum; i++) {
+#if ULTRAPING_ONE_PIN_ENABLED == true
+		_sonar[i].onePinSetTriggerMode();
+#endif
+		_sonar[i].setTriggerNotActive();   // Should already be low, but this will make sure it is.
+	}
+	delayMicroseconds(4);                  // Wait for pins to go low.
+	for (i = 0; i < _sonarNum; i++) _sonar[i].setTriggerActive(); // Tell all sensors to send out a ping.
+	delayMicroseconds(10);                 // Sensor specs say to wait 10uS.
+	for (i = 0; i < _sonarNum; i++) {
+		_sonar[i].setTriggerNotActive();
+#if ULTRAPING_ONE_PIN_ENABLED == true
+		_sonar[i].onePinSetEchoMode();
+#endif
+	}
+
+	uint16_t busy = sample(), triggered = 0;
+	for (i = 0; i < _sonarNum; i++) {
+		if (ULTRAPING_HEALTH_SKIP_OF(_sonar[i])) continue; // Quarantined, it got the pulse with the others but isn't waited for.
+		if (busy & _sensor[i].bit) {       // Previous ping hasn't finished, leave this sensor out.
+			ULTRAPING_STAT_OF(_sonar[i], trigger_aborts);
+			ULTRAPING_HEALTH_OF(_sonar[i], ULTRAPING_HEALTH_STUCK);
+		} else {
+			ULTRAPING_STAT_OF(_sonar[i], triggers);
+			triggered |= _sensor[i].bit;
+		}
+	}
+	return triggered;
+}
@@ -0,0 +1,75 @@
+// ---------------------------------------------------------------------------
+// UltraPingBank - Ping a group of sensors at once, sharing one echo poll
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// Pinging N sensors one at a time takes N pings. When the sensors face
+// different directions and can't hear each other, they can all ping at the
+// same time instead. UltraPingBank triggers all its sensors together and
+// polls their echo pins in one loop, timestamping every sensor's echo edges
+// as they come, so N sensors finish in the time of one ping.
+//
+// When all echo pins are on the same port register (e.g. pins 2-7 on an Uno,
+// port D), the loop reads the whole port once per turn, and finds the edges
+// by comparing with the previous read. Otherwise (pins on different ports,
+// or boards without port registers) it reads the pins one by one, which is
+// slower, so the timestamps are less exact.
+//
+// Only for sensors that can't hear each other, UltraPingArray handles
+// sensors that can.
+//
+// CONSTRUCTOR:
+//   UltraPingBank<SONAR_NUM> bank(sonar[])
+//     sonar[] - Array of SONAR_NUM UltraPing objects, max 16 sensors.
+//
+// METHODS:
+//   bank.ping([max_distance]) - Ping all sensors at once, and wait for all echos. Returns the number of sensors with an echo. [max_distance] sets a new max distance for all.
+//   bank.result(sensor) - Echo time in uS from the last ping (NO_ECHO if none).
+//   bank.shared_port() - True if all echo pins are read with a single port read.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingBank_h
+#define UltraPingBank_h
+
+#include <UltraPing.h>
+
+#define ULTRAPING_BANK_MAX_SENSORS 16 // Echo states are 16 bits.
+
+struct UltraPingBankSensor {
+	uint16_t bit;              // Echo pin in a sample, the port bit or the sensor number.
+	unsigned int result;       // uS, echo time.
+	unsigned long start;       // micros() when ping started.
+	unsigned long deadline;    // micros() when the ping times out.
+};
+
+class UltraPingBankBase {
+	public:
+		uint8_t ping(unsigned int max_distance = 0);
+		unsigned int result(uint8_t sensor);
+		boolean shared_port();
+	protected:
+		UltraPingBankBase(UltraPing sonar[], UltraPingBankSensor sensor[], uint8_t sonar_num);
+	private:
+		inline uint16_t sample();
+		uint16_t trigger();
+
+		UltraPing *_sonar;
+		UltraPingBankSensor *_sensor;
+		uint8_t _sonarNum;
+		uint16_t _activeLow;          // Bits of sensors whose echo is active low.
+#if ULTRAPING_DO_BITWISE == true
+		volatile uint8_t *_echoInput; // Shared port register, NULL if the pins are read one by one.
+#endif
+};
+
+template <uint8_t SONAR_NUM> class UltraPingBank : public UltraPingBankBase {
+	public:
+		UltraPingBank(UltraPing sonar[]) : UltraPingBankBase(sonar, _sensors, SONAR_NUM) {}
+	private:
+		UltraPingBankSensor _sensors[SONAR_NUM];
+};
+
+#endif
@@ -0,0 +1,73 @@
+// ---------------------------------------------------------------------------
+// UltraPingFilter, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingFilter.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingFilter.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingFilter constructor
+// ---------------------------------------------------------------------------
+
+UltraPingFilterBase::UltraPingFilterBase(UltraPing &sonar, unsigned int ring[], unsigned int sorted[], uint8_t window) {
+	_sonar = &sonar;
+	_ring = ring;
+	_sorted = sorted;
+	_window = window;
+	clear();
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingFilter methods
+// ---------------------------------------------------------------------------
+
+unsigned int UltraPingFilterBase::ping(unsigned int max_distance) {
+	return add(_sonar->ping(max_distance));
+}
+
+
+unsigned int UltraPingFilterBase::add(unsigned int echoTime) {
+	if (echoTime == ULTRAPING_NO_ECHO) return median(); // Out of range, don't include as part of median.
+
+	uint8_t j;
+	if (_count == _window) { // Full, remove the oldest sample from the sorted samples.
+		unsigned int oldest = _ring[_next];
+		for (j = 0; _sorted[j] != oldest; j++);
+		for (; j < _count - 1; j++) _sorted[j] = _sorted[j + 1];
+		_count--;
+	}
+	for (j = _count; j > 0 && _sorted[j - 1] > echoTime; j--) // Insertion sort loop.
+		_sorted[j] = _sorted[j - 1];                          // Shift larger samples up.
+	_sorted[j] = echoTime;
+	_count++;
+
+	_ring[_next] = echoTime;
+	if (++_next == _window) _next = 0;
+	return median();
+}
+
+
+unsigned int UltraPingFilterBase::median() {
+	return percentile(50);
+}
+
+
+unsigned int UltraPingFilterBase::percentile(uint8_t percent) {
+	if (_count == 0) return ULTRAPING_NO_ECHO;
+	return _sorted[((unsigned int) (_count - 1) * min(percent, 100) + 50) / 100]; // Nearest rank.
+}
+
+
+uint8_t UltraPingFilterBase::count() {
+	return _count;
+}
+
+
+void UltraPingFilterBase::clear() {
+	_count = 0;
+	_next = 0;
+}
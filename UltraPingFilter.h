@@ -0,0 +1,65 @@
+// ---------------------------------------------------------------------------
+// UltraPingFilter - Streaming median/percentile filter for UltraPing
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// ping_median(5) pings 5 times with a pause between each ping, so every
+// reading takes well over 100ms. UltraPingFilter instead keeps the last
+// WINDOW echo times, and gives an updated median after every ping. Samples
+// are kept both in arrival order and sorted, so adding a sample is
+// O(WINDOW) and reading the median or any percentile is O(1). No memory is
+// allocated, everything lives in the filter object.
+//
+// CONSTRUCTOR:
+//   UltraPingFilter<WINDOW> filter(sonar)
+//     WINDOW - Number of samples the median is taken over, max 255.
+//     sonar - The UltraPing object filter.ping() pings with.
+//
+// METHODS:
+//   filter.ping([max_distance]) - Ping once, add the echo time and return the new median in microseconds.
+//   filter.add(echoTime) - Add an echo time, like ping_result from check_timer, and return the new median. NO_ECHO is ignored.
+//   filter.median() - Median of the samples in microseconds (NO_ECHO if empty).
+//   filter.percentile(percent) - Percentile (0-100) of the samples in microseconds (NO_ECHO if empty).
+//   filter.count() - Number of samples, WINDOW once filled.
+//   filter.clear() - Forget all samples.
+//
+// When add() is called from the timer interrupt, read the results with
+// interrupts off (or copy them in the interrupt), as for ping_result.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingFilter_h
+#define UltraPingFilter_h
+
+#include <UltraPing.h>
+
+class UltraPingFilterBase {
+	public:
+		unsigned int ping(unsigned int max_distance = 0);
+		unsigned int add(unsigned int echoTime);
+		unsigned int median();
+		unsigned int percentile(uint8_t percent);
+		uint8_t count();
+		void clear();
+	protected:
+		UltraPingFilterBase(UltraPing &sonar, unsigned int ring[], unsigned int sorted[], uint8_t window);
+	private:
+		UltraPing *_sonar;
+		unsigned int *_ring;   // Samples in arrival order.
+		unsigned int *_sorted; // The same samples, sorted ascending.
+		uint8_t _window;
+		uint8_t _count;
+		uint8_t _next;         // Position in _ring for the next sample.
+};
+
+template <uint8_t WINDOW> class UltraPingFilter : public UltraPingFilterBase {
+	public:
+		UltraPingFilter(UltraPing &sonar) : UltraPingFilterBase(sonar, _ringSamples, _sortedSamples, WINDOW) {}
+	private:
+		unsigned int _ringSamples[WINDOW];
+		unsigned int _sortedSamples[WINDOW];
+};
+
+#endif
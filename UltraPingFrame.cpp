@@ -0,0 +1,114 @@
+// ---------------------------------------------------------------------------
+// UltraPingFrame, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingFrame.h" for purpose, frame layout and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingFrame.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingFrame encoder
+// ---------------------------------------------------------------------------
+
+uint8_t UltraPingFrame::encode(uint8_t buffer[], uint8_t sensor, unsigned long timestamp, const unsigned int hits[], uint8_t count) {
+	if (count > ULTRAPING_FRAME_MAX_HITS) count = ULTRAPING_FRAME_MAX_HITS; // The decoder drops longer frames.
+	uint8_t n = 2;
+	buffer[n++] = sensor;
+	buffer[n++] = timestamp & 0xFF;
+	buffer[n++] = (timestamp >> 8) & 0xFF;
+	buffer[n++] = count;
+	uint16_t previous = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		uint16_t value = hits[i] - previous; // Difference to the previous hit, 16-bit so it decodes back even if not ascending.
+		previous = hits[i];
+		while (value >= 0x80) {
+			buffer[n++] = (value & 0x7F) | 0x80;
+			value >>= 7;
+		}
+		buffer[n++] = value;
+	}
+	buffer[0] = ULTRAPING_FRAME_SYNC;
+	buffer[1] = n - 2;
+	uint16_t c = 0xFFFF;
+	for (uint8_t i = 1; i < n; i++) c = crc(c, buffer[i]);
+	buffer[n++] = c & 0xFF;
+	buffer[n++] = c >> 8;
+	return n;
+}
+
+
+uint16_t UltraPingFrame::crc(uint16_t crc, uint8_t data) { // CRC-16-CCITT, polynomial x^16 + x^12 + x^5 + 1, bit by bit to save flash.
+	crc ^= (uint16_t) data << 8;
+	for (uint8_t i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingFrame decoder
+// ---------------------------------------------------------------------------
+
+UltraPingFrameDecoder::UltraPingFrameDecoder() {
+	sensor = 0;
+	timestamp = 0;
+	count = 0;
+	errors = 0;
+	_received = 0;
+}
+
+
+boolean UltraPingFrameDecoder::feed(uint8_t data) {
+	if (_received == 0 && data != ULTRAPING_FRAME_SYNC) return false; // Looking for sync.
+	_frame[_received++] = data;
+	while (_received >= 2) {
+		uint8_t length = _frame[1];
+		if (length >= 4 && length <= sizeof(_frame) - 4) {
+			if (_received < length + 4) return false; // Not complete yet.
+			uint16_t c = 0xFFFF;
+			for (uint8_t i = 1; i <= length + 1; i++) c = UltraPingFrame::crc(c, _frame[i]);
+			if (c == (_frame[length + 2] | ((uint16_t) _frame[length + 3] << 8)) && parse()) {
+				resync(length + 4); // Keep what came after, a frame may have started in it.
+				return true;
+			}
+		}
+		errors++;   // Bad length or crc. The sync was data, look for the next one in what's received.
+		resync(1);
+	}
+	return false;
+}
+
+
+void UltraPingFrameDecoder::resync(uint8_t from) { // Drop received bytes before from, and then up to the next sync.
+	while (from < _received && _frame[from] != ULTRAPING_FRAME_SYNC) from++;
+	_received -= from;
+	for (uint8_t i = 0; i < _received; i++) _frame[i] = _frame[from + i];
+}
+
+
+boolean UltraPingFrameDecoder::parse() { // Unpack _frame into the public fields, false if it doesn't add up.
+	uint8_t n = 6, end = _frame[1] + 2;
+	uint8_t frameCount = _frame[5];
+	if (frameCount > ULTRAPING_FRAME_MAX_HITS) return false;
+	unsigned int decoded[ULTRAPING_FRAME_MAX_HITS]; // The public fields keep the last good frame until this one has added up.
+	uint16_t previous = 0;
+	for (uint8_t i = 0; i < frameCount; i++) {
+		uint16_t value = 0;
+		uint8_t shift = 0, data;
+		do {
+			if (n >= end || shift > 14) return false;
+			data = _frame[n++];
+			value |= (uint16_t) (data & 0x7F) << shift;
+			shift += 7;
+		} while (data & 0x80);
+		previous += value;
+		decoded[i] = previous;
+	}
+	if (n != end) return false;
+	sensor = _frame[2];
+	timestamp = _frame[3] | ((uint16_t) _frame[4] << 8);
+	count = frameCount;
+	for (uint8_t i = 0; i < frameCount; i++) hits[i] = decoded[i];
+	return true;
+}
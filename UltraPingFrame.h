@@ -0,0 +1,74 @@
+// ---------------------------------------------------------------------------
+// UltraPingFrame - Compact binary frames for streaming ping_multi results
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// Printing results as text costs many bytes per measurement (the ascii-graph
+// example prints MAX_DISTANCE + 2 characters per call), so the serial link
+// limits how often results can be logged. UltraPingFrame packs one
+// measurement into a few bytes: sensor, timestamp and the echo times, where
+// every echo time after the first is stored as the difference to the one
+// before, as a variable length number (1 byte below 128uS, 2 bytes below
+// 16384uS, otherwise 3 bytes).
+//
+// Frame layout:
+//   0xA5            Sync byte.
+//   length          Number of bytes from sensor to the last hit.
+//   sensor          Sensor id, 0-255.
+//   timestamp       Low 16 bits of the timestamp (e.g. millis()), little-endian.
+//   count           Number of hits.
+//   hits            First echo time, then the differences, 7 bits per byte, low bits first, high bit set if more bytes follow.
+//   crc             CRC-16-CCITT (polynomial 0x1021, start 0xFFFF) of length to the last hit, little-endian.
+//
+// A ping_multi call with 4 hits is about 15 bytes, so a 115200 baud link
+// carries over 750 of them per second.
+//
+// UltraPingFrameDecoder is fed one received byte at a time and tells when a
+// valid frame is complete. Bytes outside frames and frames with a bad CRC are
+// skipped, and a sync byte inside a dropped frame is tried as the start of
+// the next, so a damaged frame costs at most itself. It works both on an Arduino receiving frames and on a host, see
+// extras/sim/UltraPingFrameDump.cpp.
+//
+// METHODS:
+//   UltraPingFrame::encode(buffer[], sensor, timestamp, hits[], count) - Write a frame to buffer (at least ULTRAPING_FRAME_SIZE(count) bytes), returns the number of bytes. Only the first ULTRAPING_FRAME_MAX_HITS hits are sent.
+//   decoder.feed(byte) - Add a received byte, returns true when a valid frame is complete.
+//   decoder.sensor, decoder.timestamp, decoder.count, decoder.hits[] - The last complete frame.
+//   decoder.errors - Number of frames dropped for bad length or CRC.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingFrame_h
+#define UltraPingFrame_h
+
+#include <UltraPing.h>
+
+#define ULTRAPING_FRAME_SYNC 0xA5                               // First byte of every frame.
+#define ULTRAPING_FRAME_MAX_HITS 16                             // Most hits in a frame the decoder accepts.
+#define ULTRAPING_FRAME_SIZE(COUNT) (2 + 4 + 3 * (COUNT) + 2)  // Largest frame with COUNT hits, in bytes.
+
+class UltraPingFrame {
+	public:
+		static uint8_t encode(uint8_t buffer[], uint8_t sensor, unsigned long timestamp, const unsigned int hits[], uint8_t count);
+		static uint16_t crc(uint16_t crc, uint8_t data);
+};
+
+class UltraPingFrameDecoder {
+	public:
+		UltraPingFrameDecoder();
+		boolean feed(uint8_t data);
+		uint8_t sensor;
+		uint16_t timestamp;
+		uint8_t count;
+		unsigned int hits[ULTRAPING_FRAME_MAX_HITS];
+		unsigned long errors;
+	private:
+		boolean parse();
+		void resync(uint8_t from);
+
+		uint8_t _frame[ULTRAPING_FRAME_SIZE(ULTRAPING_FRAME_MAX_HITS)];
+		uint8_t _received; // Bytes in _frame, from sync. 0 while looking for sync.
+};
+
+#endif
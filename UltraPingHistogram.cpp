@@ -0,0 +1,96 @@
+// ---------------------------------------------------------------------------
+// UltraPingHistogram, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingHistogram.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingHistogram.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingHistogram constructor
+// ---------------------------------------------------------------------------
+
+UltraPingHistogramBase::UltraPingHistogramBase(uint8_t score[], uint8_t stamp[], uint8_t bins, uint8_t bin_length) {
+	_score = score;
+	_stamp = stamp;
+	_bins = bins;
+	_binLength = max(bin_length, 1);
+	half_life = ULTRAPING_HISTOGRAM_HALF_LIFE;
+	threshold = ULTRAPING_HISTOGRAM_THRESHOLD;
+	clear();
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingHistogram methods
+// ---------------------------------------------------------------------------
+
+void UltraPingHistogramBase::add(unsigned int hits[], unsigned int count) {
+	_call++;
+	if ((_call & ULTRAPING_HISTOGRAM_REFRESH) == 0) // Before the call counter can wrap around a stamp, decay all bins.
+		for (uint8_t bin = 0; bin < _bins; bin++) decay(bin);
+
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int bin = UltraPing::convert_length(hits[i]);
+		if (_binLength > 1) bin /= _binLength;
+		if (bin >= _bins) continue;  // Beyond the last bin.
+		uint8_t since = decay(bin), life = half_life_calls();
+		unsigned int s = _score[bin] + ULTRAPING_HISTOGRAM_HIT * 2U * life / (2 * life - since); // The score is kept as of the last whole halving, where a hit now is worth more.
+		if (s > 255) { // Doesn't fit as of then, start over from now.
+			s = min(score(bin) + ULTRAPING_HISTOGRAM_HIT, 255);
+			_stamp[bin] = _call;
+		}
+		_score[bin] = s;
+	}
+}
+
+
+uint8_t UltraPingHistogramBase::peaks(unsigned int peaks[], uint8_t maximum_peaks) {
+	uint8_t found = 0, left = 0, s = score(0), right;
+	for (uint8_t bin = 0; bin < _bins && found < maximum_peaks; bin++) {
+		right = bin + 1 < _bins ? score(bin + 1) : 0;
+		if (s >= threshold && s > left && s >= right) // Local maximum, first bin of a plateau.
+			peaks[found++] = (unsigned int) bin * _binLength;
+		left = s;
+		s = right;
+	}
+	return found;
+}
+
+
+uint8_t UltraPingHistogramBase::score(uint8_t bin) {
+	if (bin >= _bins) return 0;
+	uint8_t life = half_life_calls();
+	uint8_t age = _call - _stamp[bin];
+	uint8_t halvings = age / life;
+	if (halvings >= 8) return 0;
+	uint8_t s = _score[bin] >> halvings;
+	return s - (unsigned int) s * (age % life) / (2 * life); // From the last whole halving, decay linearly (close to the exponential curve, and never applied twice).
+}
+
+
+void UltraPingHistogramBase::clear() {
+	_call = 0;
+	for (uint8_t bin = 0; bin < _bins; bin++) _score[bin] = _stamp[bin] = 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingHistogram support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+uint8_t UltraPingHistogramBase::decay(uint8_t bin) { // Apply the whole halvings since the bin's stamp, returns the calls since the last of them.
+	uint8_t life = half_life_calls();
+	uint8_t age = _call - _stamp[bin];
+	uint8_t halvings = age / life;
+	_score[bin] = halvings >= 8 ? 0 : _score[bin] >> halvings;
+	_stamp[bin] = _score[bin] ? _stamp[bin] + halvings * life : _call; // An empty bin starts over now.
+	return _call - _stamp[bin];
+}
+
+
+uint8_t UltraPingHistogramBase::half_life_calls() { // The stamps are 8-bit, a half life and the 128 calls between refreshes have to fit.
+	return min(max(half_life, 1), 128);
+}
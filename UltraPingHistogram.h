@@ -0,0 +1,76 @@
+// ---------------------------------------------------------------------------
+// UltraPingHistogram - Echo histogram over successive ping_multi calls
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// A single ping_multi snapshot has spurious hits and misses echos now and
+// then. UltraPingHistogram divides the range in BINS bins, adds the hits of
+// every ping_multi call to their bins, and lets old hits fade away (the
+// score of a bin halves every half_life calls). Bins with a high enough
+// score that are local maximums are confirmed echos (peaks).
+// Decay is lazy: a bin remembers its score at its last whole halving and is
+// decayed when it's read or hit, so add() costs time per hit, not per bin.
+// Whole half lives halve the score, only the part of a half life since the
+// last halving is interpolated (linearly, a little above the exponential
+// curve), so updates don't compound. The curve is still approximate: a bin
+// too full to keep its score as of the last halving starts over from its
+// interpolated score. Every 128 calls all bins are brought up to date, so the
+// 8-bit call counter can wrap. Memory is 2 bytes per bin.
+//
+// CONSTRUCTOR:
+//   UltraPingHistogram<BINS> histogram([bin_length])
+//     BINS - Number of bins, max 255. Hits beyond the last bin are ignored.
+//     bin_length - [Optional] Bin size in length units. Default=1
+//
+// METHODS:
+//   histogram.add(hits[], count) - Add the hits (echo times in uS) of one ping_multi call.
+//   histogram.peaks(peaks[], maximum_peaks) - Confirmed echos, as distance in length units to the bin start, returns number of peaks.
+//   histogram.score(bin) - Current score of bin, 0-255.
+//   histogram.clear() - Forget all hits.
+//   histogram.half_life - Calls for a score to halve, 1-128. Default=2
+//   histogram.threshold - Lowest score of a peak. Default=80 (more than one hit recently)
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingHistogram_h
+#define UltraPingHistogram_h
+
+#include <UltraPing.h>
+
+#define ULTRAPING_HISTOGRAM_HIT 64        // Score added to a bin for each hit. Default=64
+#define ULTRAPING_HISTOGRAM_HALF_LIFE 2   // Default half life in calls. Default=2
+#define ULTRAPING_HISTOGRAM_THRESHOLD 80  // Default lowest score of a peak, more than one recent hit. Default=80
+#define ULTRAPING_HISTOGRAM_REFRESH 0x7F  // Bring all bins up to date when (calls & REFRESH) == 0, must be below 255. Default=0x7F
+
+class UltraPingHistogramBase {
+	public:
+		void add(unsigned int hits[], unsigned int count);
+		uint8_t peaks(unsigned int peaks[], uint8_t maximum_peaks);
+		uint8_t score(uint8_t bin);
+		void clear();
+		uint8_t half_life;
+		uint8_t threshold;
+	protected:
+		UltraPingHistogramBase(uint8_t score[], uint8_t stamp[], uint8_t bins, uint8_t bin_length);
+	private:
+		uint8_t decay(uint8_t bin);
+		uint8_t half_life_calls();
+
+		uint8_t *_score;
+		uint8_t *_stamp;  // Call of the bin's last whole halving, _score is as of then.
+		uint8_t _bins;
+		uint8_t _binLength;
+		uint8_t _call;    // Number of calls to add(), wraps.
+};
+
+template <uint8_t BINS> class UltraPingHistogram : public UltraPingHistogramBase {
+	public:
+		UltraPingHistogram(uint8_t bin_length = 1) : UltraPingHistogramBase(_scores, _stamps, BINS, bin_length) {}
+	private:
+		uint8_t _scores[BINS];
+		uint8_t _stamps[BINS];
+};
+
+#endif
@@ -0,0 +1,54 @@
+// ---------------------------------------------------------------------------
+// UltraPingQueue, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingQueue.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingQueue.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingQueue constructor
+// ---------------------------------------------------------------------------
+
+UltraPingQueueBase::UltraPingQueueBase(UltraPingResult slot[], uint8_t mask) {
+	_slot = slot;
+	_mask = mask;
+	clear();
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingQueue methods
+// ---------------------------------------------------------------------------
+
+boolean UltraPingQueueBase::pop(UltraPingResult &result) {
+	uint8_t tail = _tail;
+	if (tail == _head) return false; // Empty.
+	ULTRAPING_BARRIER();
+	result = _slot[tail];
+	ULTRAPING_BARRIER();
+	_tail = (tail + 1) & _mask;      // Hand the slot back to the writer.
+	return true;
+}
+
+
+uint8_t UltraPingQueueBase::available() {
+	return (_head - _tail) & _mask;
+}
+
+
+unsigned long UltraPingQueueBase::overflows() {
+	ULTRAPING_ATOMIC_BEGIN(); // Counted from the interrupt, read all 4 bytes at once.
+	unsigned long overflows = _overflows;
+	ULTRAPING_ATOMIC_END();
+	return overflows;
+}
+
+
+void UltraPingQueueBase::clear() {
+	_head = 0;
+	_tail = 0;
+	_overflows = 0;
+}
@@ -0,0 +1,91 @@
+// ---------------------------------------------------------------------------
+// UltraPingQueue - Result queue from the timer interrupt to loop()
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// ping_timer, ping_multi_timer and ping_edge leave their result in
+// ping_result, which the next result overwrites. If loop() is slower than
+// the pings, results are lost without notice, and on 8-bit AVR loop() can
+// read ping_result half old and half new. With a queue set, every result is
+// also added to a ring buffer, which loop() empties at its own pace.
+// The interrupt only adds and loop() only removes, each side owns its own
+// index, so neither side waits for the other or turns interrupts off. When
+// the queue is full, new results are dropped and counted.
+//
+// CONSTRUCTOR:
+//   UltraPingQueue<SIZE> queue
+//     SIZE - Number of slots, a power of 2 up to 256. Holds SIZE - 1 results.
+//
+// METHODS:
+//   sonar.set_queue(&queue) - Add every result of this sensor's timer and edge methods to queue (NULL to stop). Several sensors may share a queue, as long as only one adds at a time.
+//   queue.pop(result) - Move the oldest result to result (an UltraPingResult), returns false if the queue is empty.
+//   queue.available() - Number of results in the queue.
+//   queue.overflows() - Number of results dropped because the queue was full.
+//   queue.clear() - Forget all results (only while nothing is adding).
+//
+// Results are added from interrupts: by check_timer (echo or NO_ECHO at
+// time-out), check_multi_timer (number of hits) and ping_edge (echo, or
+// NO_ECHO beyond max distance). A ping_edge time-out found by check_edge
+// is not added, it's detected in loop(). pop() must only be called from
+// one place, not from an interrupt.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingQueue_h
+#define UltraPingQueue_h
+
+#include <UltraPing.h>
+
+// Keeps the compiler from moving memory accesses across it, so a slot is written before it's published and read before it's freed.
+#define ULTRAPING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+struct UltraPingResult {
+	UltraPing *sonar;      // Sensor the result is from.
+	unsigned long time;    // micros() when the result was ready.
+	unsigned int echo;     // uS, echo time, or first hit from ping_multi_timer (NO_ECHO if none).
+	uint8_t hits;          // Number of hits from ping_multi_timer, otherwise 1 with an echo and 0 without.
+};
+
+class UltraPingQueueBase {
+	public:
+		inline boolean push(const UltraPingResult &result); // Called from the interrupt (not called directly).
+		boolean pop(UltraPingResult &result);
+		uint8_t available();
+		unsigned long overflows();
+		void clear();
+	protected:
+		UltraPingQueueBase(UltraPingResult slot[], uint8_t mask);
+	private:
+		UltraPingResult *_slot;
+		uint8_t _mask;             // Number of slots - 1.
+		volatile uint8_t _head;    // Next slot to write, only changed by push.
+		volatile uint8_t _tail;    // Next slot to read, only changed by pop.
+		volatile unsigned long _overflows;
+};
+
+// Defined in the header, so UltraPing's interrupt code can inline it.
+inline boolean UltraPingQueueBase::push(const UltraPingResult &result) {
+	uint8_t head = _head;
+	uint8_t next = (head + 1) & _mask;
+	if (next == _tail) { // Full, drop the new result rather than touch the reader's index.
+		_overflows++;
+		return false;
+	}
+	_slot[head] = result;
+	ULTRAPING_BARRIER();
+	_head = next;        // Single byte write, the reader sees the slot all at once.
+	return true;
+}
+
+
+template <uint16_t SIZE> class UltraPingQueue : public UltraPingQueueBase {
+	static_assert(SIZE >= 2 && SIZE <= 256 && !(SIZE & (SIZE - 1)), "UltraPingQueue SIZE must be a power of 2, from 2 to 256.");
+	public:
+		UltraPingQueue() : UltraPingQueueBase(_slots, SIZE - 1) {}
+	private:
+		UltraPingResult _slots[SIZE];
+};
+
+#endif
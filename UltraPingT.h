@@ -0,0 +1,127 @@
+// ---------------------------------------------------------------------------
+// UltraPingT - UltraPing with pins fixed at compile-time
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// UltraPing reads its port registers and bit masks from the object, so every
+// pin access in the ping loops loads a pointer and a mask first. When the
+// pins are known when compiling, UltraPingT resolves them to fixed registers
+// instead, so the echo poll can compile to a single sbis instruction (trigger
+// writes to sbi/cbi). That is an estimate from the instruction set, not
+// measured on hardware: run the UltraPingTCycles example on the board for the
+// real cycle counts.
+//
+// Fixed registers are mapped for ATmega168/328 (Uno, Nano, Pro Mini), and
+// Teensy uses digitalReadFast/digitalWriteFast. On other boards, or pins
+// outside the map, UltraPingT falls back to the same run-time pins as
+// UltraPing, so it always works.
+//
+// CONSTRUCTOR:
+//   UltraPingT<TRIGGER_PIN, ECHO_PIN [, PROFILE]> sonar([max_distance])
+//     TRIGGER_PIN & ECHO_PIN - Arduino pins connected to sensor trigger and echo, constants.
+//     PROFILE - [Optional] Sensor profile (see UltraPing.h), its echo polarity is fixed in the echo poll too. Default=UltraPingAnySensor
+//     max_distance - [Optional] Maximum distance you wish to sense. Default=500cm.
+//
+// METHODS:
+//   Same as UltraPing. ping, ping_length, ping_median, ping_multi and
+//   ping_threshold use the fixed pins. The timer and edge methods, and
+//   UltraPingArray/UltraPingFilter, use UltraPing's pins (an UltraPingT is an
+//   UltraPing). The calls are recorded with set_trace() like UltraPing's.
+//   sonar.fixed_pins - True if both pins are fixed at compile-time.
+//
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingT_h
+#define UltraPingT_h
+
+#include <UltraPing.h>
+
+// ---------------------------------------------------------------------------
+// Compile-time pins, UltraPingPin<PIN>::mapped is true if the pin has fixed registers.
+// ---------------------------------------------------------------------------
+
+#if defined (ULTRAPING_SIM) || (defined (__arm__) && defined (TEENSYDUINO))
+	#if defined (TEENSYDUINO)
+		#define ULTRAPING_PIN_READ digitalReadFast   // Constant pin, compiles to a single register access.
+		#define ULTRAPING_PIN_WRITE digitalWriteFast
+	#else
+		#define ULTRAPING_PIN_READ digitalRead
+		#define ULTRAPING_PIN_WRITE digitalWrite
+	#endif
+	template <uint8_t PIN> struct UltraPingPin {
+		static const boolean mapped = true;
+		static inline boolean read() { return ULTRAPING_PIN_READ(PIN); }
+		static inline void high() { ULTRAPING_PIN_WRITE(PIN, HIGH); }
+		static inline void low() { ULTRAPING_PIN_WRITE(PIN, LOW); }
+		static inline void output() { pinMode(PIN, OUTPUT); }
+		static inline void input() { pinMode(PIN, INPUT); }
+	};
+#else
+	template <uint8_t PIN> struct UltraPingPin {
+		static const boolean mapped = false; // No fixed registers known for this pin.
+	};
+
+	#define ULTRAPING_PIN_MAP(NUMBER, LETTER, BIT) \
+		template <> struct UltraPingPin<NUMBER> { \
+			static const boolean mapped = true; \
+			static inline boolean read() { return PIN##LETTER & _BV(BIT); } \
+			static inline void high() { PORT##LETTER |= _BV(BIT); } \
+			static inline void low() { PORT##LETTER &= ~_BV(BIT); } \
+			static inline void output() { DDR##LETTER |= _BV(BIT); } \
+			static inline void input() { DDR##LETTER &= ~_BV(BIT); } \
+		};
+
+	#if defined (__AVR_ATmega168__) || defined (__AVR_ATmega168P__) || defined (__AVR_ATmega328__) || defined (__AVR_ATmega328P__)
+		ULTRAPING_PIN_MAP(0, D, 0)  ULTRAPING_PIN_MAP(1, D, 1)  ULTRAPING_PIN_MAP(2, D, 2)  ULTRAPING_PIN_MAP(3, D, 3)
+		ULTRAPING_PIN_MAP(4, D, 4)  ULTRAPING_PIN_MAP(5, D, 5)  ULTRAPING_PIN_MAP(6, D, 6)  ULTRAPING_PIN_MAP(7, D, 7)
+		ULTRAPING_PIN_MAP(8, B, 0)  ULTRAPING_PIN_MAP(9, B, 1)  ULTRAPING_PIN_MAP(10, B, 2) ULTRAPING_PIN_MAP(11, B, 3)
+		ULTRAPING_PIN_MAP(12, B, 4) ULTRAPING_PIN_MAP(13, B, 5) ULTRAPING_PIN_MAP(14, C, 0) ULTRAPING_PIN_MAP(15, C, 1)
+		ULTRAPING_PIN_MAP(16, C, 2) ULTRAPING_PIN_MAP(17, C, 3) ULTRAPING_PIN_MAP(18, C, 4) ULTRAPING_PIN_MAP(19, C, 5)
+	#endif
+#endif
+
+
+// ---------------------------------------------------------------------------
+// Pin interface for UltraPing's ping loops, fixed pins if both are mapped, otherwise UltraPing's run-time pins.
+// ---------------------------------------------------------------------------
+
+template <uint8_t TRIGGER_PIN, uint8_t ECHO_PIN, boolean ACTIVE_LOW, boolean MAPPED = UltraPingPin<TRIGGER_PIN>::mapped && UltraPingPin<ECHO_PIN>::mapped>
+struct UltraPingFixedPins : public UltraPingRuntimePins {};
+
+template <uint8_t TRIGGER_PIN, uint8_t ECHO_PIN, boolean ACTIVE_LOW> struct UltraPingFixedPins<TRIGGER_PIN, ECHO_PIN, ACTIVE_LOW, true> {
+	static inline boolean echoActive(UltraPing &) { return (boolean) UltraPingPin<ECHO_PIN>::read() != ACTIVE_LOW; }
+	static inline void setTriggerActive(UltraPing &) { UltraPingPin<TRIGGER_PIN>::high(); }
+	static inline void setTriggerNotActive(UltraPing &) { UltraPingPin<TRIGGER_PIN>::low(); }
+#if ULTRAPING_ONE_PIN_ENABLED == true
+	static inline void onePinSetTriggerMode(UltraPing &) { UltraPingPin<TRIGGER_PIN>::output(); }
+	static inline void onePinSetEchoMode(UltraPing &) { UltraPingPin<TRIGGER_PIN>::input(); }
+#endif
+};
+
+
+// ---------------------------------------------------------------------------
+// UltraPingT
+// ---------------------------------------------------------------------------
+
+template <uint8_t TRIGGER_PIN, uint8_t ECHO_PIN, class PROFILE = UltraPingAnySensor> class UltraPingT : public UltraPing {
+	public:
+		UltraPingT(unsigned int max_distance = ULTRAPING_MAX_SENSOR_DISTANCE) : UltraPing(TRIGGER_PIN, ECHO_PIN, max_distance, PROFILE()) {}
+		unsigned int ping(unsigned int max_distance = 0) { return ping_traced<Pins>(max_distance); }
+		unsigned long ping_length(unsigned int max_distance = 0) { return convert_length(ping(max_distance)); }
+		unsigned long ping_median(uint8_t it = 5, unsigned int max_distance = 0) { return ping_median_traced<Pins>(it, max_distance); }
+		unsigned int ping_multi(unsigned int hits[], unsigned int maximum_hits, unsigned int threshold_distance = 0, unsigned int max_distance = 0) {
+			return ping_multi_traced<Pins>(hits, maximum_hits, threshold_distance, max_distance);
+		}
+		unsigned int ping_threshold(unsigned int threshold_distance, unsigned int max_distance = 0) {
+			unsigned int hit[] = {ULTRAPING_NO_ECHO};
+			ping_multi(hit, 1, threshold_distance, max_distance);
+			return hit[0];
+		}
+		static const boolean fixed_pins = UltraPingPin<TRIGGER_PIN>::mapped && UltraPingPin<ECHO_PIN>::mapped;
+		typedef UltraPingFixedPins<TRIGGER_PIN, ECHO_PIN, PROFILE::active_low> Pins;
+};
+
+#endif
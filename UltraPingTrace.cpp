@@ -0,0 +1,79 @@
+// ---------------------------------------------------------------------------
+// UltraPingTrace, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingTrace.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingTrace.h>
+
+#if ULTRAPING_TRACE_ENABLED == true
+
+// ---------------------------------------------------------------------------
+// UltraPingTrace constructor
+// ---------------------------------------------------------------------------
+
+UltraPingTraceBase::UltraPingTraceBase(UltraPingTraceEvent event[], unsigned int size) {
+	_event = event;
+	_size = size;
+	clear();
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingTrace methods
+// ---------------------------------------------------------------------------
+
+void UltraPingTraceBase::add(uint8_t type, unsigned long value) {
+	if (type == ULTRAPING_TRACE_TRIGGER) { // Recorded as time since the previous trigger.
+		unsigned long time = value;
+		value = _triggered ? time - _lastTrigger : 0xFFFF;
+		_lastTrigger = time;
+		_triggered = true;
+	}
+	if (_count >= _size) {
+		_full = true;
+		return;
+	}
+	_event[_count].type = type;
+	_event[_count].value = min(value, 0xFFFFUL);
+	_count++;
+}
+
+
+void UltraPingTraceBase::dump(Print &out) {
+	static const char letters[] = ULTRAPING_TRACE_LETTERS;
+	out.print("trace ");
+	out.print(_count);
+	for (unsigned int i = 0; i < _count; i++) {
+		out.print(i % 16 ? ' ' : '\n'); // 16 events per line.
+		out.print(_event[i].type < ULTRAPING_TRACE_EVENTS ? letters[_event[i].type] : '?');
+		out.print(_event[i].value);
+	}
+	out.println();
+	out.println(_full ? "full" : "end");
+}
+
+
+unsigned int UltraPingTraceBase::count() {
+	return _count;
+}
+
+
+boolean UltraPingTraceBase::full() {
+	return _full;
+}
+
+
+UltraPingTraceEvent UltraPingTraceBase::event(unsigned int i) {
+	return _event[i];
+}
+
+
+void UltraPingTraceBase::clear() {
+	_count = 0;
+	_full = false;
+	_triggered = false;
+}
+
+#endif
@@ -0,0 +1,87 @@
+// ---------------------------------------------------------------------------
+// UltraPingTrace - Recording of raw ping events, for replay on a PC
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// When ping_multi gives odd results in the field, the echo pin's behaviour
+// that caused them is gone. With ULTRAPING_TRACE_ENABLED set to true in
+// UltraPing.h and a trace set with sonar.set_trace(&trace), ping, ping_median
+// and ping_multi record every call with its arguments, every trigger, when
+// the ping started and the echo ended (or that it didn't), the offsets
+// ping_multi chose and the results, 3 bytes per event. trace.dump(Serial)
+// prints it as text, and extras/sim/UltraPingReplay.cpp feeds it through the
+// unmodified ping methods on Linux, with a simulated sensor that answers
+// every trigger as the real one did.
+//
+// The trace fills from the start and then stops recording, so set it (or
+// clear it) just before the calls of interest. Replay starts from a new
+// sensor, so it follows the recording exactly when the trace is set in
+// setup(), before the first ping.
+//
+// CONSTRUCTOR:
+//   UltraPingTrace<SIZE> trace
+//     SIZE - Number of events, a ping_multi call with 4 hits is about 40.
+//
+// METHODS:
+//   trace.dump(out) - Print the events to out (e.g. Serial) as text, see below.
+//   trace.count() - Number of events recorded.
+//   trace.full() - True if events were lost because the trace is full.
+//   trace.event(i) - Event i (an UltraPingTraceEvent, type is one of ULTRAPING_TRACE_*).
+//   trace.clear() - Forget all events and start recording again.
+//
+// DUMP FORMAT:
+//   "trace <count>", then one letter and value per event, separated by
+//   spaces and new lines, then "end" (or "full" if events were lost).
+//   X max echo uS, P ping(max_distance), D ping_median(iterations),
+//   M ping_multi(maximum_hits), A further argument, T trigger (uS since the
+//   previous), B trigger aborted, S started (uS after trigger), N no start,
+//   E echo (uS after start), Z no echo, O second ping offset (uS), R result,
+//   H hit (uS), G round budget.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingTrace_h
+#define UltraPingTrace_h
+
+#include <UltraPing.h>
+
+#if ULTRAPING_TRACE_ENABLED == true
+
+#define ULTRAPING_TRACE_LETTERS "XPDMATBSNEZORHG" // Dump letter of each event type.
+
+struct UltraPingTraceEvent {
+	uint8_t type;
+	uint16_t value;            // uS or argument, 65535 if larger.
+};
+
+class UltraPingTraceBase {
+	public:
+		void add(uint8_t type, unsigned long value); // Called by UltraPing (not called directly).
+		void dump(Print &out);
+		unsigned int count();
+		boolean full();
+		UltraPingTraceEvent event(unsigned int i);
+		void clear();
+	protected:
+		UltraPingTraceBase(UltraPingTraceEvent event[], unsigned int size);
+	private:
+		UltraPingTraceEvent *_event;
+		unsigned int _size;
+		unsigned int _count;
+		boolean _full;
+		boolean _triggered;         // A trigger is recorded, _lastTrigger is valid.
+		unsigned long _lastTrigger; // micros() of the last trigger.
+};
+
+template <unsigned int SIZE> class UltraPingTrace : public UltraPingTraceBase {
+	public:
+		UltraPingTrace() : UltraPingTraceBase(_events, SIZE) {}
+	private:
+		UltraPingTraceEvent _events[SIZE];
+};
+
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+// ---------------------------------------------------------------------------
+// UltraPingTracker, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingTracker.h" for purpose, syntax and more.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingTracker.h>
+
+
+// ---------------------------------------------------------------------------
+// UltraPingTracker constructor
+// ---------------------------------------------------------------------------
+
+UltraPingTrackerBase::UltraPingTrackerBase(UltraPing &sonar, UltraPingTrack track[], unsigned int probe[], uint8_t matched[], uint8_t tracks) {
+	_sonar = &sonar;
+	_track = track;
+	_probe = probe;
+	_matched = matched;
+	_tracks = tracks;
+	_count = 0;
+	search_rounds = ULTRAPING_TRACKER_SEARCH_ROUNDS;
+	gate = ULTRAPING_TRACKER_GATE;
+	max_misses = ULTRAPING_TRACKER_MAX_MISSES;
+	alpha = ULTRAPING_TRACKER_ALPHA;
+	beta = ULTRAPING_TRACKER_BETA;
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingTracker methods
+// ---------------------------------------------------------------------------
+
+unsigned int UltraPingTrackerBase::ping_multi(unsigned int hits[], unsigned int maximum_hits, unsigned int threshold_distance, unsigned int max_distance) {
+	prepare();
+	unsigned int found = _sonar->ping_multi(hits, maximum_hits, threshold_distance, max_distance);
+	update(hits, found);
+	return found;
+}
+
+
+void UltraPingTrackerBase::prepare() {
+	for (uint8_t i = 0; i < _count; i++) // Tracks are sorted, so the probes are too.
+		_probe[i] = max(_track[i].position + _track[i].velocity, 0L) >> 4;
+	_sonar->set_multi_probes(_probe, _count);
+	_sonar->set_round_budget(_count + search_rounds); // One round per track, the rest for searching.
+}
+
+
+void UltraPingTrackerBase::update(unsigned int hits[], unsigned int count) {
+	uint8_t i, known = _count;
+	unsigned int first = 0; // First hit not taken by an earlier track.
+
+	for (i = 0; i < known; i++) { // Match each track with the closest hit to its prediction, hits and tracks are both sorted.
+		long predicted = _track[i].position + _track[i].velocity;
+		unsigned int best = gate + 1;
+		_matched[i] = 0;
+		for (unsigned int h = first; h < count; h++) { // Keep the order, a hit goes to one track.
+			long distance = labs(((long) hits[h] << 4) - predicted) >> 4;
+			if (distance < best) {
+				best = distance;
+				_matched[i] = h + 1;
+			}
+		}
+		if (_matched[i]) first = _matched[i];
+	}
+
+	for (i = known; i > 0; i--) { // Update tracks (backwards, so removing keeps the indexes of the tracks left).
+		UltraPingTrack &t = _track[i - 1];
+		long predicted = t.position + t.velocity;
+		if (_matched[i - 1]) {
+			long residual = ((long) hits[_matched[i - 1] - 1] << 4) - predicted;
+			t.position = predicted + residual * alpha / 256;
+			t.velocity += residual * beta / 256;
+			t.misses = 0;
+		} else {
+			t.position = predicted; // Coast on the prediction.
+			if (++t.misses > max_misses) remove(i - 1);
+		}
+	}
+	sort(); // Tracks may have passed each other, prepare() and the matching above need them in order.
+
+	for (unsigned int h = 0; h < count; h++) { // Hits no track took start new tracks.
+		boolean used = false;
+		for (i = 0; i < known; i++) if (_matched[i] == h + 1) used = true;
+		if (!used) insert((long) hits[h] << 4, 0);
+	}
+}
+
+
+uint8_t UltraPingTrackerBase::count() {
+	return _count;
+}
+
+
+unsigned int UltraPingTrackerBase::position(uint8_t track) {
+	return track < _count ? max(_track[track].position, 0L) >> 4 : ULTRAPING_NO_ECHO;
+}
+
+
+int UltraPingTrackerBase::velocity(uint8_t track) {
+	return track < _count ? _track[track].velocity / 16 : 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// UltraPingTracker support functions (not called directly)
+// ---------------------------------------------------------------------------
+
+void UltraPingTrackerBase::insert(long position, long velocity) { // Insert a track in position order, if there's room.
+	if (_count == _tracks) return;
+	uint8_t i;
+	for (i = _count; i > 0 && _track[i - 1].position > position; i--) _track[i] = _track[i - 1];
+	_track[i].position = position;
+	_track[i].velocity = velocity;
+	_track[i].misses = 0;
+	_count++;
+}
+
+
+void UltraPingTrackerBase::remove(uint8_t track) {
+	for (uint8_t i = track; i + 1 < _count; i++) _track[i] = _track[i + 1];
+	_count--;
+}
+
+
+void UltraPingTrackerBase::sort() { // Insertion sort by position, the tracks are almost always in order already.
+	for (uint8_t i = 1; i < _count; i++) {
+		UltraPingTrack t = _track[i];
+		uint8_t j;
+		for (j = i; j > 0 && _track[j - 1].position > t.position; j--) _track[j] = _track[j - 1];
+		_track[j] = t;
+	}
+}
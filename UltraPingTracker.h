@@ -0,0 +1,90 @@
+// ---------------------------------------------------------------------------
+// UltraPingTracker - Tracks moving echos over ping_multi calls
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// ping_multi starts every call from scratch and rediscovers each echo by
+// probing from the first echo and out. When the targets move smoothly, the
+// next echo times can be predicted instead. UltraPingTracker keeps an
+// alpha-beta filter (position and velocity) per echo, fed by the hits of
+// every call. Before each call it hands the predicted echo times to
+// ping_multi as probes, with a round budget of one round per track plus
+// search_rounds, so known echos are confirmed in one round each and the
+// rounds left over search for new echos.
+//
+// CONSTRUCTOR:
+//   UltraPingTracker<TRACKS> tracker(sonar)
+//     TRACKS - Max number of echos tracked.
+//     sonar - The UltraPing object to ping with, the tracker sets its round budget.
+//
+// METHODS:
+//   tracker.ping_multi(hits[], maximum_hits, [threshold_distance], [max_distance]) - ping_multi aimed at the tracks, then update() with the hits. Returns number of hits.
+//   tracker.prepare() - Give the predicted echos to the sonar's next ping_multi or ping_multi_timer (use with ping_multi_timer).
+//   tracker.update(hits[], count) - Update the tracks with the hits (echo times in uS) of one call.
+//   tracker.count() - Number of tracks.
+//   tracker.position(track) - Estimated echo time of track in uS, tracks are sorted by echo time.
+//   tracker.velocity(track) - Estimated change of echo time per call in uS.
+//   tracker.search_rounds - Rounds per call for finding new echos. Default=1
+//   tracker.gate - Max uS between predicted echo and hit to belong to the track. Default=300 (about 5cm)
+//   tracker.max_misses - Calls in a row without a hit before a track is dropped. Default=3
+//   tracker.alpha, tracker.beta - Filter gains in 1/256 for position and velocity. Default=128, 32
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingTracker_h
+#define UltraPingTracker_h
+
+#include <UltraPing.h>
+
+#define ULTRAPING_TRACKER_SEARCH_ROUNDS 1 // Default rounds per call looking for new echos. Default=1
+#define ULTRAPING_TRACKER_GATE 300        // Default max uS between prediction and hit. Default=300
+#define ULTRAPING_TRACKER_MAX_MISSES 3    // Default calls without hit before a track is dropped. Default=3
+#define ULTRAPING_TRACKER_ALPHA 128       // Default position gain, in 1/256. Default=128
+#define ULTRAPING_TRACKER_BETA 32         // Default velocity gain, in 1/256. Default=32
+
+struct UltraPingTrack {
+	long position;   // uS x 16, echo time.
+	long velocity;   // uS x 16, change per call.
+	uint8_t misses;  // Calls in a row without a hit.
+};
+
+class UltraPingTrackerBase {
+	public:
+		unsigned int ping_multi(unsigned int hits[], unsigned int maximum_hits, unsigned int threshold_distance = 0, unsigned int max_distance = 0);
+		void prepare();
+		void update(unsigned int hits[], unsigned int count);
+		uint8_t count();
+		unsigned int position(uint8_t track);
+		int velocity(uint8_t track);
+		uint8_t search_rounds;
+		unsigned int gate;
+		uint8_t max_misses;
+		uint8_t alpha;
+		uint8_t beta;
+	protected:
+		UltraPingTrackerBase(UltraPing &sonar, UltraPingTrack track[], unsigned int probe[], uint8_t matched[], uint8_t tracks);
+	private:
+		void insert(long position, long velocity);
+		void remove(uint8_t track);
+		void sort();
+
+		UltraPing *_sonar;
+		UltraPingTrack *_track; // Sorted by position.
+		unsigned int *_probe;
+		uint8_t *_matched; // Hit index + 1 matched to each track in update(), 0 = none.
+		uint8_t _tracks;
+		uint8_t _count;
+};
+
+template <uint8_t TRACKS> class UltraPingTracker : public UltraPingTrackerBase {
+	public:
+		UltraPingTracker(UltraPing &sonar) : UltraPingTrackerBase(sonar, _trackData, _probes, _matchedData, TRACKS) {}
+	private:
+		UltraPingTrack _trackData[TRACKS];
+		unsigned int _probes[TRACKS];
+		uint8_t _matchedData[TRACKS];
+};
+
+#endif
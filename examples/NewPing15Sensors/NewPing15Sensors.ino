@@ -60,7 +60,7 @@ void loop() {
 
 void echoCheck() { // If ping received, set the sensor distance to array.
   if (sonar[currentSensor].check_timer())
-    cm[currentSensor] = sonar[currentSensor].ping_result / US_ROUNDTRIP_CM;
+    cm[currentSensor] = UltraPing::convert_length(sonar[currentSensor].ping_result);
 }
 
 void oneSensorCycle() { // Sensor ping cycle complete, do something with the results.
@@ -39,7 +39,7 @@ void echoCheck() { // Timer2 interrupt calls this function every 24uS where you
   if (sonar.check_timer()) { // This is how you check to see if the ping was received.
     // Here's where you can add code.
     Serial.print("Ping: ");
-    Serial.print(sonar.ping_result / US_ROUNDTRIP_CM); // Ping returned, uS result in ping_result, convert to cm with US_ROUNDTRIP_CM.
+    Serial.print(UltraPing::convert_length(sonar.ping_result)); // Ping returned, uS result in ping_result, convert to cm with convert_length (no division, fast enough for the interrupt).
     Serial.println("cm");
   }
   // Don't do anything here!
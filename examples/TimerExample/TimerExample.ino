@@ -3,8 +3,8 @@
 // the Timer2 interrupt was a result of creating an interrupt-based ping method. Since these Timer2
 // interrupt methods were built, the library may as well provide the functionality to use these methods
 // in your sketches.  This shows how simple it is (no ultrasonic sensor required).  Keep in mind that
-// these methods use Timer2, as does NewPing's ping_timer method for using ultrasonic sensors.  You
-// can't use ping_timer at the same time you're using timer_ms or timer_us as all use the same timer.
+// these methods use Timer2, as does UltraPing's ping_timer method for using ultrasonic sensors. They
+// share it, each in a slot of its own, so ping_timer, timer_ms and timer_us can all run at once.
 // ---------------------------------------------------------------------------
 
 #include <UltraPing.h>
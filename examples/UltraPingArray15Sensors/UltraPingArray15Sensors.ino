@@ -0,0 +1,69 @@
+// ---------------------------------------------------------------------------
+// Same 15 sensors as the NewPing15Sensors example, but scheduled by UltraPingArray. Instead of a
+// fixed 33ms slot per sensor, a sensor's slot ends when its echo has arrived and decayed, and
+// sensors that can't hear each other ping at the same time. Here the sensors are mounted in a ring,
+// facing outwards, so every sensor can only hear its two neighbours. One cycle of all sensors then
+// takes a fraction of the 495ms of the NewPing15Sensors example. The results are sent to the
+// "oneSensorCycle" function, which is called from the timer interrupt, so just copy the results
+// there and do the work in loop().
+// ---------------------------------------------------------------------------
+#include <UltraPingArray.h>
+
+#define SONAR_NUM     15 // Number of sensors.
+#define MAX_DISTANCE 200 // Maximum distance (in cm) to ping.
+
+UltraPing sonar[SONAR_NUM] = {     // Sensor object array.
+  UltraPing(41, 42, MAX_DISTANCE), // Each sensor's trigger pin, echo pin, and max distance to ping.
+  UltraPing(43, 44, MAX_DISTANCE),
+  UltraPing(45, 20, MAX_DISTANCE),
+  UltraPing(21, 22, MAX_DISTANCE),
+  UltraPing(23, 24, MAX_DISTANCE),
+  UltraPing(25, 26, MAX_DISTANCE),
+  UltraPing(27, 28, MAX_DISTANCE),
+  UltraPing(29, 30, MAX_DISTANCE),
+  UltraPing(31, 32, MAX_DISTANCE),
+  UltraPing(34, 33, MAX_DISTANCE),
+  UltraPing(35, 36, MAX_DISTANCE),
+  UltraPing(37, 38, MAX_DISTANCE),
+  UltraPing(39, 40, MAX_DISTANCE),
+  UltraPing(50, 51, MAX_DISTANCE),
+  UltraPing(52, 53, MAX_DISTANCE)
+};
+
+UltraPingArray<SONAR_NUM> sonars(sonar); // Schedules all sensors from the timer interrupt.
+
+unsigned int cm[SONAR_NUM];   // Where the ping distances are stored.
+unsigned long cycleTime;      // uS for one cycle of all sensors.
+volatile boolean cycleDone = false;
+
+void setup() {
+  Serial.begin(115200);
+  for (uint8_t i = 0; i < SONAR_NUM; i++) { // Every sensor can only hear its neighbours in the ring.
+    uint8_t previous = (i + SONAR_NUM - 1) % SONAR_NUM;
+    uint8_t next = (i + 1) % SONAR_NUM;
+    sonars.set_cross_talk(i, (1 << previous) | (1 << next));
+  }
+  // sonars.jitter = 2000;     // Or ping all sensors at once, each after a random wait of up to 2ms, and drop readings that move with the wait (cross-talk).
+  sonars.start(oneSensorCycle); // Ping all sensors over and over, calls oneSensorCycle after every cycle.
+}
+
+void loop() {
+  if (cycleDone) {
+    cycleDone = false;
+    for (uint8_t i = 0; i < SONAR_NUM; i++) {
+      Serial.print(i);
+      Serial.print("=");
+      Serial.print(cm[i]);
+      Serial.print("cm ");
+    }
+    Serial.print(cycleTime / 1000);
+    Serial.println("ms");
+  }
+  // Other code that *DOESN'T* analyze ping results can go here.
+}
+
+void oneSensorCycle() { // Sensor ping cycle complete, called from the timer interrupt.
+  for (uint8_t i = 0; i < SONAR_NUM; i++) cm[i] = UltraPing::convert_length(sonars.result(i));
+  cycleTime = sonars.cycle_time();
+  cycleDone = true;
+}
@@ -0,0 +1,40 @@
+// ---------------------------------------------------------------------------
+// Four sensors facing front, back, left and right, pinged all at once by UltraPingBank. The
+// sensors can't hear each other, so there's no need to take turns: one ping measures all four.
+// Each sensor uses one pin for both trigger and echo (ONE_PIN_ENABLED), and the pins 4 to 7 are all
+// on port D of an Uno, so the echos of all four are read with a single port read.
+// ---------------------------------------------------------------------------
+#include <UltraPingBank.h>
+
+#define SONAR_NUM      4 // Number of sensors.
+#define MAX_DISTANCE 200 // Maximum distance (in cm) to ping.
+
+UltraPing sonar[SONAR_NUM] = {     // Sensor object array.
+  UltraPing(4, 4, MAX_DISTANCE),   // Each sensor's trigger pin, echo pin, and max distance to ping.
+  UltraPing(5, 5, MAX_DISTANCE),
+  UltraPing(6, 6, MAX_DISTANCE),
+  UltraPing(7, 7, MAX_DISTANCE)
+};
+
+UltraPingBank<SONAR_NUM> bank(sonar); // Pings all sensors at once.
+
+void setup() {
+  Serial.begin(115200);
+  Serial.print("Shared port: ");
+  Serial.println(bank.shared_port() ? "yes" : "no"); // If no, the pins are read one by one.
+}
+
+void loop() {
+  delay(30);                     // Wait for echos from the last ping to ebb away.
+  unsigned long start = micros();
+  bank.ping();                   // Ping all sensors, returns when all echos are in.
+  unsigned long duration = micros() - start;
+  for (uint8_t i = 0; i < SONAR_NUM; i++) {
+    Serial.print(i);
+    Serial.print("=");
+    Serial.print(UltraPing::convert_length(bank.result(i)));
+    Serial.print("cm ");
+  }
+  Serial.print(duration);
+  Serial.println("uS");
+}
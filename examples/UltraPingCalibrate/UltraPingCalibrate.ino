@@ -0,0 +1,46 @@
+// ---------------------------------------------------------------------------
+// Example of calibrate(), times the sensor at start-up. Point it at a wall or
+// anything else within MAX_DISTANCE while it starts. Sensors of the same type
+// differ in how long they take to restart, calibrate() finds out for this one,
+// so ping_multi doesn't aim rounds at echos it can't tell apart.
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+
+#define TRIGGER_PIN  12  // Arduino pin tied to trigger pin on the ultrasonic sensor.
+#define ECHO_PIN     11  // Arduino pin tied to echo pin on the ultrasonic sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define MAX_HITS     4   // Maximum number of echos to look for.
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+unsigned int hits[MAX_HITS];
+
+void setup() {
+  Serial.begin(115200);
+  UltraPingCalibration calibration;
+  while (!sonar.calibrate(&calibration)) { // No echo, keeps the default timing until it gets one.
+    Serial.println("Nothing to calibrate against within range.");
+    delay(1000);
+  }
+  Serial.print("Latency: ");
+  Serial.print(calibration.latency_min);
+  Serial.print('-');
+  Serial.print(calibration.latency_max);
+  Serial.print("uS Dead time: ");
+  Serial.print(calibration.dead_time);
+  Serial.print("uS Separation: ");
+  Serial.print(calibration.min_separation);
+  Serial.println("uS");
+}
+
+void loop() {
+  delay(50);
+  unsigned int count = sonar.ping_multi(hits, MAX_HITS);
+  Serial.print("Echos:");
+  for (unsigned int i = 0; i < count; i++) {
+    Serial.print(' ');
+    Serial.print(UltraPing::convert_length(hits[i]));
+    Serial.print("cm");
+  }
+  Serial.print(" Rounds: ");
+  Serial.println(sonar.multi_rounds);
+}
@@ -0,0 +1,39 @@
+// ---------------------------------------------------------------------------
+// This example shows how to use UltraPing's ping_edge method. Instead of checking the echo pin every
+// 24uS from a timer interrupt like ping_timer, ping_edge gets one interrupt when the echo starts and
+// one when it ends, so it uses much less CPU and the resolution is the resolution of micros() (4uS on
+// a 16MHz AVR). The echo pin must support attachInterrupt(), on Arduino Uno that is pin 2 or 3.
+// With EDGE_ICP1 set to true in UltraPing.h, Timer1 input capture is used instead (echo on pin 8 on
+// Uno, 0.5uS resolution), but then Timer1 can't be used for other things (like the Servo library).
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+
+#define TRIGGER_PIN  12 // Arduino pin tied to trigger pin on ping sensor.
+#define ECHO_PIN      2 // Arduino pin tied to echo pin on ping sensor, must support attachInterrupt().
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE); // UltraPing setup of pins and maximum distance.
+
+unsigned int pingSpeed = 50; // How frequently are we going to send out a ping (in milliseconds).
+unsigned long pingTimer;     // Holds the next ping time.
+
+void setup() {
+  Serial.begin(115200); // Open serial monitor at 115200 baud to see ping results.
+  pingTimer = millis(); // Start now.
+}
+
+void loop() {
+  if (millis() >= pingTimer) {  // pingSpeed milliseconds since last ping, do another ping.
+    pingTimer += pingSpeed;     // Set the next ping time.
+    sonar.ping_edge(echoDone);  // Send out the ping, calls "echoDone" when the echo has ended.
+  }
+  // Do other stuff here.
+}
+
+void echoDone() { // Called from the echo pin interrupt when the echo has ended.
+  if (sonar.check_edge()) { // True if the echo was within the set distance limit.
+    Serial.print("Ping: ");
+    Serial.print(sonar.ping_result / 57); // Ping returned, uS result in ping_result, convert to cm with 57uS per cm.
+    Serial.println("cm");
+  }
+}
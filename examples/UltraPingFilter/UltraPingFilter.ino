@@ -0,0 +1,44 @@
+// ---------------------------------------------------------------------------
+// Example of UltraPingFilter, a median filter that gives a new filtered reading after every ping.
+// ping_median(5) pings 5 times for every reading, here every ping from ping_timer is added to the
+// filter, so filtered readings arrive at the same rate as the pings.
+// ---------------------------------------------------------------------------
+#include <UltraPingFilter.h>
+
+#define TRIGGER_PIN   12 // Arduino pin tied to trigger pin on ping sensor.
+#define ECHO_PIN      11 // Arduino pin tied to echo pin on ping sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define WINDOW         5 // Number of pings the median is taken over.
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingFilter<WINDOW> filter(sonar); // Median of the last WINDOW pings.
+
+unsigned int pingSpeed = 33; // How frequently are we going to send out a ping (in milliseconds).
+unsigned long pingTimer;     // Holds the next ping time.
+volatile unsigned int filtered; // Latest filtered echo time, set from the timer interrupt.
+volatile boolean newReading = false;
+
+void setup() {
+  Serial.begin(115200);
+  pingTimer = millis();
+}
+
+void loop() {
+  if (millis() >= pingTimer) {
+    pingTimer += pingSpeed;
+    sonar.ping_timer(echoCheck);
+  }
+  if (newReading) {
+    newReading = false;
+    Serial.print("Median: ");
+    Serial.print(UltraPing::convert_length(filtered));
+    Serial.println("cm");
+  }
+}
+
+void echoCheck() { // Timer interrupt calls this function every 24uS.
+  if (sonar.check_timer()) {
+    filtered = filter.add(sonar.ping_result); // Add the ping, get the new median.
+    newReading = true;
+  }
+}
@@ -0,0 +1,42 @@
+// ---------------------------------------------------------------------------
+// Example of health(), three sensors pinged in turn. Unplug one while it runs:
+// after a few failed pings it's quarantined and its pings return at once, so
+// the other two keep their pace. It's probed now and then, plug it back in and
+// it's in use again at the next probe.
+// ---------------------------------------------------------------------------
+#define ULTRAPING_HEALTH_ENABLED true // Must be defined before the include.
+#include <UltraPing.h>
+
+#define SONAR_NUM    3   // Number of sensors.
+#define MAX_DISTANCE 200 // Maximum distance (in cm) to ping.
+
+UltraPing sonar[SONAR_NUM] = { // Sensor object array.
+  UltraPing(4, 5, MAX_DISTANCE), // Each sensor's trigger pin, echo pin, and max distance to ping.
+  UltraPing(6, 7, MAX_DISTANCE),
+  UltraPing(8, 9, MAX_DISTANCE)
+};
+
+void setup() {
+  Serial.begin(115200);
+}
+
+void loop() {
+  for (uint8_t i = 0; i < SONAR_NUM; i++) {
+    delay(30); // Wait between pings, so the previous sensor's echo has died out.
+    unsigned int cm = UltraPing::convert_length(sonar[i].ping());
+    Serial.print(i);
+    Serial.print(": ");
+    if (sonar[i].quarantined()) {
+      Serial.print("quarantined");
+    } else {
+      switch (sonar[i].health()) {
+        case ULTRAPING_HEALTH_OK:       Serial.print(cm); Serial.print("cm"); break;
+        case ULTRAPING_HEALTH_NO_ECHO:  Serial.print("nothing in range"); break;
+        case ULTRAPING_HEALTH_STUCK:    Serial.print("echo stuck"); break;
+        case ULTRAPING_HEALTH_NO_START: Serial.print("no start"); break;
+      }
+    }
+    Serial.print("  ");
+  }
+  Serial.println();
+}
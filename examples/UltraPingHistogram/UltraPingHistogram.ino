@@ -0,0 +1,44 @@
+//Example ping_multi with UltraPingHistogram, a stable ascii-graph of confirmed echos.
+
+//Like UltraPingMultiAsciiGraph, but the hits of each ping_multi call are added to a histogram
+//where they fade away over a few calls. Only echos seen in several calls are drawn, so spurious
+//hits and missed echos don't flicker. Few hits per call are enough, the histogram collects the
+//rest over time: every other call looks beyond THRESHOLD_DISTANCE.
+#include <UltraPingHistogram.h>
+
+//Settings for this example:
+#define MAX_DISTANCE 100       //In length unit, centimeter is default.
+#define THRESHOLD_DISTANCE 50  //Every other call starts looking for hits here.
+#define MAXIMUM_HITS 2         //Max number of hits per call.
+#define MAXIMUM_PEAKS 10       //Max number of echos to draw.
+#define BAUD 57600             //Make sure your terminal is set to same.
+#define TRIGGER_PIN 12
+#define ECHO_PIN 12            //Can be connected to same if ONE_PIN_ENABLED == true
+
+UltraPing up(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingHistogram<MAX_DISTANCE + 1> histogram; //One bin per cm.
+
+unsigned int hit[MAXIMUM_HITS];
+unsigned int peak[MAXIMUM_PEAKS];
+char output[MAX_DISTANCE + 2];
+boolean far = false;
+
+void setup() {
+	Serial.begin(BAUD);
+	while(!Serial);
+	Serial.println("UltraPing Example - ping_multi with UltraPingHistogram");
+}
+
+void loop() {
+	//Measure, and add the hits to the histogram. Cost is per hit, not per bin.
+	int hits = up.ping_multi(hit, MAXIMUM_HITS, far ? THRESHOLD_DISTANCE : 0);
+	histogram.add(hit, hits);
+	far = !far;
+
+	//Draw the confirmed echos.
+	for(int i = 0; i <= MAX_DISTANCE; i++) output[i] = '_';
+	output[MAX_DISTANCE+1] = 0;
+	uint8_t peaks = histogram.peaks(peak, MAXIMUM_PEAKS);
+	for(uint8_t i = 0; i < peaks; i++) output[min(MAX_DISTANCE, peak[i])] = '|';
+	Serial.println(output);
+}
@@ -46,7 +46,10 @@ void loop() {
 	}
 
 	//Print it out. A terminal with monospace font will best to represent the graph..
-	Serial.println(output);
+	//Each round is two pings and an echo ebb away delay, multi_rounds tells how many were needed.
+	Serial.print(output);
+	Serial.print(" rounds: ");
+	Serial.println(up.multi_rounds);
 	//Don't trigger to often, echos can still be around.
 	delay(50);
 }
@@ -0,0 +1,38 @@
+//Example ping_multi streaming results as compact binary frames.
+//The ascii-graph example prints MAX_DISTANCE + 2 characters per measure, this
+//sends about 15 bytes for 4 hits. The frames are not readable in a terminal,
+//capture them and decode with extras/sim/UltraPingFrameDump.cpp:
+//  stty -F /dev/ttyACM0 115200 raw && ./ultraping_frame_dump < /dev/ttyACM0 > echos.csv
+
+#include <UltraPing.h>
+#include <UltraPingFrame.h>
+
+//Settings for this example:
+#define MAX_DISTANCE 200     //In length unit, centimeter is default.
+#define MAXIMUM_HITS 8       //Max number of hits to detect, at most ULTRAPING_FRAME_MAX_HITS.
+#define BAUD 115200
+#define SENSOR_ID 0          //Tells sensors apart if several boards log to the same file.
+#define TRIGGER_PIN 12
+#define ECHO_PIN 11
+
+UltraPing up(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+
+unsigned int hit[MAXIMUM_HITS];
+uint8_t frame[ULTRAPING_FRAME_SIZE(MAXIMUM_HITS)];
+
+void setup() {
+	Serial.begin(BAUD);
+	while(!Serial);
+}
+
+
+void loop() {
+	uint8_t hits = up.ping_multi(hit, MAXIMUM_HITS);
+
+	//The frame holds the low 16 bits of millis(), the decoder unwraps them.
+	uint8_t length = UltraPingFrame::encode(frame, SENSOR_ID, millis(), hit, hits);
+
+	//Only write when the whole frame fits in the transmit buffer, so a slow
+	//link drops frames instead of stalling the measures.
+	if (Serial.availableForWrite() >= length) Serial.write(frame, length);
+}
@@ -0,0 +1,42 @@
+// ---------------------------------------------------------------------------
+// Example of set_multi_reuse(). After a hit, ping_multi sends the next second
+// ping from the same first ping instead of waiting for all echos to ebb away
+// and measuring the first echo again, so a scene with many echos takes less
+// time. Every REUSE rounds the first echo is measured again, and also after a
+// window without a hit, so it saves a trigger per hit in a row, not one per
+// round (in the simulator, 4 echos take 11 triggers instead of 12).
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+
+#define TRIGGER_PIN  12  // Arduino pin tied to trigger pin on the ultrasonic sensor.
+#define ECHO_PIN     11  // Arduino pin tied to echo pin on the ultrasonic sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define MAX_HITS     6   // Maximum number of echos to look for.
+#define REUSE        4   // Rounds that may share one first ping (max ULTRAPING_MULTI_REUSE_MAX).
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+unsigned int hits[MAX_HITS];
+
+void setup() {
+  Serial.begin(115200);
+  sonar.calibrate();           // Dead time of this sensor, if something is in range.
+  sonar.set_multi_reuse(REUSE);
+}
+
+void loop() {
+  unsigned long start = millis();
+  unsigned int count = sonar.ping_multi(hits, MAX_HITS);
+  unsigned long took = millis() - start;
+  Serial.print("Echos:");
+  for (unsigned int i = 0; i < count; i++) {
+    Serial.print(' ');
+    Serial.print(UltraPing::convert_length(hits[i]));
+    Serial.print("cm");
+  }
+  Serial.print(" Rounds: ");
+  Serial.print(sonar.multi_rounds);
+  Serial.print(" Time: ");
+  Serial.print(took);
+  Serial.println("ms");
+  delay(50);
+}
@@ -0,0 +1,48 @@
+//Example ping_multi_timer, multiple echos measured in the background.
+
+//ping_multi_timer does the same measurement as ping_multi, but the timer interrupt
+//advances it, so loop() is free to do other work during the measurement.
+//Only one ping_multi_timer can run at a time, it shares the timer with ping_timer, timer_us and timer_ms.
+#include <UltraPing.h>
+
+
+//Settings for this example:
+#define MAX_DISTANCE 200     //In length unit, centimeter is default.
+#define THRESHOLD_DISTANCE 0 //In length unit, hits shorter than this limit is not reported.
+#define MAXIMUM_HITS 5       // Max number of hits to detect.
+#define BAUD 57600           // Make sure your terminal is set to same.
+#define TRIGGER_PIN 12
+#define ECHO_PIN 11
+
+UltraPing up(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+
+unsigned int hit[MAXIMUM_HITS];
+volatile boolean done = true;
+
+void setup() {
+	Serial.begin(BAUD);
+	while(!Serial);
+	Serial.println("UltraPing Example - Demonstrating ping_multi_timer");
+}
+
+
+void loop() {
+	if (done) {
+		//Print the hits of the last measurement, number of hits is in ping_result.
+		for(unsigned int i = 0; i < up.ping_result; i++) {
+			Serial.print(up.convert_length(hit[i]));
+			Serial.print(" ");
+		}
+		Serial.println();
+
+		//Start next measurement, multiCheck is called from the timer interrupt until it is done.
+		done = !up.ping_multi_timer(hit, MAXIMUM_HITS, multiCheck, THRESHOLD_DISTANCE);
+	}
+	// Do other stuff here, the measurement runs in the background.
+}
+
+void multiCheck() { // Timer interrupt calls this function to advance the measurement.
+	if (up.check_multi_timer()) { // True when all hits are found, or no more echos.
+		done = true;
+	}
+}
@@ -0,0 +1,32 @@
+// ---------------------------------------------------------------------------
+// Example of sensor profiles, two different sensor types in one sketch.
+// Each sensor gets the timing of its type, so an unplugged HC-SR04 fails after
+// about 1ms instead of 35ms, and ping_multi on the waterproof JSN-SR04T doesn't
+// look for echos inside its ring-down.
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define MAX_HITS       4 // Maximum number of echos to look for.
+
+UltraPing front(12, 11, MAX_DISTANCE, UltraPingHCSR04());  // Trigger pin 12, echo pin 11.
+UltraPing tank(10, 9, MAX_DISTANCE, UltraPingJSNSR04T());  // Trigger pin 10, echo pin 9.
+unsigned int hits[MAX_HITS];
+
+void setup() {
+  Serial.begin(115200);
+}
+
+void loop() {
+  delay(50);
+  Serial.print("Front: ");
+  Serial.print(front.ping_length()); // 0 = outside set distance range (or no sensor).
+  Serial.print("cm Tank:");
+  unsigned int count = tank.ping_multi(hits, MAX_HITS);
+  for (unsigned int i = 0; i < count; i++) {
+    Serial.print(' ');
+    Serial.print(UltraPing::convert_length(hits[i]));
+    Serial.print("cm");
+  }
+  Serial.println();
+}
@@ -0,0 +1,46 @@
+// ---------------------------------------------------------------------------
+// Example of UltraPingQueue, keeping every ping_timer result until loop() has time for it.
+// Pings go out every 33ms, while loop() only prints once a second. Each result is queued
+// from the timer interrupt with the time it arrived, and loop() prints the whole batch.
+// ---------------------------------------------------------------------------
+#include <UltraPingQueue.h>
+
+#define TRIGGER_PIN   12 // Arduino pin tied to trigger pin on ping sensor.
+#define ECHO_PIN      11 // Arduino pin tied to echo pin on ping sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingQueue<64> queue; // Room for 63 results, about 2 seconds of pings.
+
+unsigned int pingSpeed = 33; // How frequently are we going to send out a ping (in milliseconds).
+unsigned long pingTimer;     // Holds the next ping time.
+unsigned long printTimer;    // Holds the next print time.
+
+void setup() {
+  Serial.begin(115200);
+  sonar.set_queue(&queue); // Every result from check_timer is also added to the queue.
+  pingTimer = printTimer = millis();
+}
+
+void loop() {
+  if (millis() >= pingTimer) {
+    pingTimer += pingSpeed;
+    sonar.ping_timer(echoCheck);
+  }
+  if (millis() >= printTimer) {
+    printTimer += 1000;
+    UltraPingResult result;
+    while (queue.pop(result)) { // Oldest first, every ping since the last print.
+      Serial.print(result.time);
+      Serial.print("uS: ");
+      Serial.print(UltraPing::convert_length(result.echo)); // 0 = outside set distance range.
+      Serial.println("cm");
+    }
+    Serial.print("Dropped: ");
+    Serial.println(queue.overflows());
+  }
+}
+
+void echoCheck() { // Timer interrupt calls this function every 24uS.
+  sonar.check_timer(); // The result goes to the queue, nothing else to do here.
+}
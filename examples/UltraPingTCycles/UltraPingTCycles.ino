@@ -0,0 +1,50 @@
+// ---------------------------------------------------------------------------
+// Counts CPU cycles per iteration of the echo poll, UltraPing (pins from the object) against
+// UltraPingT (pins fixed at compile-time). Uses Timer1 at full CPU clock, so ATmega168/328 only
+// (Uno, Nano, Pro Mini). The echo pin just needs to be low, no sensor has to be connected.
+// Each loop is run ITERATIONS times with interrupts off, once with the bare pin read and once with
+// the micros() time-out check the ping loops also do.
+// ---------------------------------------------------------------------------
+#include <UltraPingT.h>
+
+#define TRIGGER_PIN 12 // Arduino pin tied to trigger pin on the ultrasonic sensor.
+#define ECHO_PIN    11 // Arduino pin tied to echo pin on the ultrasonic sensor.
+#define ITERATIONS 100
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN);
+UltraPingT<TRIGGER_PIN, ECHO_PIN> sonarT;
+
+template <class PINS> unsigned int pollCycles(UltraPing &sonar, boolean timeout) {
+  uint8_t n = ITERATIONS;
+  unsigned long end = 0xFFFFFFFF;
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10); // Count CPU cycles.
+  TCNT1 = 0;
+  if (timeout) {
+    while (!PINS::echoActive(sonar) && --n) if (micros() > end) break;
+  } else {
+    while (!PINS::echoActive(sonar) && --n);
+  }
+  unsigned int cycles = TCNT1;
+  interrupts();
+  return cycles;
+}
+
+void print(const char *name, unsigned int cycles) {
+  Serial.print(name);
+  Serial.print(cycles / (float) ITERATIONS);
+  Serial.println(" cycles per iteration");
+}
+
+void setup() {
+  Serial.begin(115200);
+  Serial.print("Fixed pins: ");
+  Serial.println(sonarT.fixed_pins ? "yes" : "no (pins not in the map, same as UltraPing)");
+  print("UltraPing poll:            ", pollCycles<UltraPingRuntimePins>(sonar, false));
+  print("UltraPingT poll:           ", pollCycles<UltraPingT<TRIGGER_PIN, ECHO_PIN>::Pins>(sonarT, false));
+  print("UltraPing poll + micros:   ", pollCycles<UltraPingRuntimePins>(sonar, true));
+  print("UltraPingT poll + micros:  ", pollCycles<UltraPingT<TRIGGER_PIN, ECHO_PIN>::Pins>(sonarT, true));
+}
+
+void loop() {}
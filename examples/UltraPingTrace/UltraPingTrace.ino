@@ -0,0 +1,39 @@
+// ---------------------------------------------------------------------------
+// Example of UltraPingTrace, recording what ping_multi does for replay on a PC.
+// Set ULTRAPING_TRACE_ENABLED to true in UltraPing.h first. Every ping_multi call
+// is recorded, and when the hits look wrong (here: none, or the first hit moved
+// more than 10cm), or 'd' is sent over serial, the trace is printed and cleared.
+// Save the serial output and replay it with extras/sim/UltraPingReplay.cpp.
+// ---------------------------------------------------------------------------
+#include <UltraPingTrace.h>
+
+#if ULTRAPING_TRACE_ENABLED == false
+  #error "Set ULTRAPING_TRACE_ENABLED to true in UltraPing.h"
+#endif
+
+#define TRIGGER_PIN   12 // Arduino pin tied to trigger pin on ping sensor.
+#define ECHO_PIN      11 // Arduino pin tied to echo pin on ping sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define MAX_HITS       8 // Maximum number of echos to look for.
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingTrace<400> trace; // About 10 ping_multi calls, 1200 bytes.
+unsigned int hits[MAX_HITS];
+unsigned int previous = 0;  // Last first hit, in length units.
+
+void setup() {
+  Serial.begin(115200);
+  sonar.set_trace(&trace); // Record from the first ping, so the replay starts from the same state.
+}
+
+void loop() {
+  delay(50);
+  unsigned int count = sonar.ping_multi(hits, MAX_HITS);
+  unsigned int first = count ? UltraPing::convert_length(hits[0]) : 0;
+  boolean odd = count == 0 || (previous && (first > previous + 10 || first + 10 < previous));
+  previous = first;
+  if (odd || (Serial.available() && Serial.read() == 'd') || trace.full()) {
+    trace.dump(Serial); // The calls that led up to this one.
+    trace.clear();
+  }
+}
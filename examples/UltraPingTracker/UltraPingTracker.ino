@@ -0,0 +1,43 @@
+//Example ping_multi with UltraPingTracker, following moving echos.
+
+//The tracker predicts where each echo will be in the next call and aims ping_multi at those
+//times, one round per echo, plus one round looking for new echos. Each call prints the tracked
+//echos, with how many uS their echo time changes per call.
+#include <UltraPingTracker.h>
+
+//Settings for this example:
+#define MAX_DISTANCE 200       //In length unit, centimeter is default.
+#define MAXIMUM_HITS 4         //Max number of hits per call.
+#define MAXIMUM_TRACKS 4       //Max number of echos to follow.
+#define BAUD 57600             //Make sure your terminal is set to same.
+#define TRIGGER_PIN 12
+#define ECHO_PIN 12            //Can be connected to same if ONE_PIN_ENABLED == true
+
+UltraPing up(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingTracker<MAXIMUM_TRACKS> tracker(up);
+
+unsigned int hit[MAXIMUM_HITS];
+
+void setup() {
+	Serial.begin(BAUD);
+	while(!Serial);
+	Serial.println("UltraPing Example - ping_multi with UltraPingTracker");
+}
+
+void loop() {
+	//Measure, aimed at the tracks, and update them with the hits.
+	unsigned long start = millis();
+	tracker.ping_multi(hit, MAXIMUM_HITS);
+	unsigned long duration = millis() - start;
+
+	for(uint8_t i = 0; i < tracker.count(); i++) {
+		Serial.print(UltraPing::convert_length(tracker.position(i)));
+		Serial.print("cm (");
+		Serial.print(tracker.velocity(i));
+		Serial.print("uS) ");
+	}
+	Serial.print("in ");
+	Serial.print(duration);
+	Serial.print("ms, rounds: ");
+	Serial.println(up.multi_rounds);
+}
@@ -0,0 +1,40 @@
+// ---------------------------------------------------------------------------
+// Example of set_yield, doing other work while ping_multi waits between pings.
+// Most of a ping_multi call is spent waiting for echos to ebb away. With a yield
+// function, that time goes to the sketch, here keeping an LED blinking steadily
+// while ping_multi blocks, without rewriting the sketch for the timer methods.
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+
+#define TRIGGER_PIN   12 // Arduino pin tied to trigger pin on ping sensor.
+#define ECHO_PIN      11 // Arduino pin tied to echo pin on ping sensor.
+#define MAX_DISTANCE 200 // Maximum distance we want to ping for (in centimeters).
+#define MAX_HITS       5 // Maximum number of echos to look for.
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+unsigned int hits[MAX_HITS];
+unsigned long blinkTimer; // Holds the next LED toggle time.
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(LED_BUILTIN, OUTPUT);
+  blinkTimer = millis();
+  UltraPing::set_yield(work, 100); // work() returns within 100uS.
+}
+
+void loop() {
+  unsigned int count = sonar.ping_multi(hits, MAX_HITS);
+  for (unsigned int i = 0; i < count; i++) {
+    Serial.print(UltraPing::convert_length(hits[i]));
+    Serial.print("cm ");
+  }
+  Serial.println();
+  work(); // Between calls too.
+}
+
+void work() { // Short work, called from loop() and from inside ping_multi.
+  if (millis() >= blinkTimer) {
+    blinkTimer += 250;
+    digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
+  }
+}
@@ -0,0 +1,335 @@
+// ---------------------------------------------------------------------------
+// Benchmark of the ping methods against scripted scenes in the simulator.
+// Every method and parameter set is run against every scene, and for each
+// the virtual latency, CPU time, triggers, rounds and accuracy against the
+// scene's ground truth are printed as one CSV line. The simulator is
+// deterministic, so the output is the same on every run and can be kept as a
+// baseline to catch regressions in the measurement algorithms.
+//
+// Scenes (max distance 200cm):
+//   single - One reflector at 100cm.
+//   close  - A strong reflector at 12cm with two secondary echos, and one at 90cm.
+//   dense  - Six reflectors, 35cm to 160cm, weaker with distance.
+//   none   - Nothing to hear.
+//
+// After the scenes, ping, ping_median and ping_multi are called once on a
+// dead sensor (no sensor on its pins) at the longest max distance. Each must
+// return NO_ECHO within DEAD_LIMIT ms per ping, a call that never returns is
+// caught by an alarm. Build with -DULTRAPING_FAST_CLOCK=true as well, a start
+// wait that doesn't fit in 16-bit ticks has its own path.
+//
+// Columns:
+//   scene, method, params - What was run.
+//   calls                 - Calls measured.
+//   latency_ms            - Mean virtual time from call to result.
+//   latency_max_ms        - Longest call.
+//   busy_ms               - Mean CPU time in busy-wait loops (micros() and digitalRead()).
+//   delay_ms              - Mean CPU time in delay() and delayMicroseconds().
+//   isr_ms                - Mean CPU time in interrupts.
+//   triggers              - Mean accepted trigger pulses per call.
+//   rounds_per_hit        - Mean ping_multi rounds per hit (0 for other methods).
+//   hit_rate              - Share of expected echos found within 100uS of the truth (for none: share of calls returning NO_ECHO).
+//   error_us              - Mean absolute error of the echos found, in uS.
+//
+// Without the timer methods (-DULTRAPING_TIMER_ENABLED=false), ping_timer and
+// ping_multi_timer are left out.
+//
+// Build and run from the library folder:
+//   g++ -O2 -DULTRAPING_SIM -I. -Iextras/sim UltraPing.cpp extras/sim/UltraPingSim.cpp extras/sim/UltraPingBench.cpp -o ultraping_bench
+//   ./ultraping_bench > results.csv
+//   ./ultraping_bench extras/sim/UltraPingBench.csv
+// With a baseline file it compares instead, prints every regression and
+// exits with 1 if there are any. Latency, CPU time and triggers may grow 5%,
+// hit_rate may drop 0.01 and error_us may grow 5uS. UltraPingBench.csv is
+// made with the default switches, -DULTRAPING_SETTLE_ADAPTIVE=true should
+// only show shorter latencies against it.
+// A dead sensor call that is too slow or returns an echo is also a regression.
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define TRIGGER_PIN  12
+#define ECHO_PIN     11
+#define MAX_DISTANCE 200
+#define CALLS        200
+#define MAXIMUM_HITS 8
+#define TOLERANCE    100 // uS between an echo and the truth to count as found.
+#define DEAD_TRIGGER 3   // Pins with no simulated sensor.
+#define DEAD_ECHO    2
+#define DEAD_LIMIT   40  // ms per ping on a dead sensor, start wait at max distance (34.3ms) and some.
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingSimSensor sensor(TRIGGER_PIN, ECHO_PIN);
+
+struct Scene {
+	const char *name;
+	float cm[6];
+	float strength[6];
+	uint8_t secondary[6];
+	uint8_t reflectors;
+};
+
+const Scene scenes[] = {
+	{"single", {100}, {1.0}, {0}, 1},
+	{"close", {12, 90}, {1.0, 0.6}, {2, 0}, 2},
+	{"dense", {35, 60, 85, 110, 135, 160}, {0.8, 0.7, 0.6, 0.5, 0.4, 0.3}, {0, 0, 0, 0, 0, 0}, 6},
+	{"none", {0}, {0}, {0}, 0},
+};
+
+enum Method { PING, PING_THRESHOLD, PING_MULTI, PING_MEDIAN, PING_TIMER, PING_MULTI_TIMER };
+
+struct Run {
+	Method method;
+	const char *name;
+	const char *params;
+	unsigned int a; // hits, threshold cm or iterations.
+	uint8_t budget;
+};
+
+const Run runs[] = {
+	{PING, "ping", "-", 0, 0},
+	{PING_THRESHOLD, "ping_threshold", "threshold=50", 50, 0},
+	{PING_MULTI, "ping_multi", "hits=1", 1, 0},
+	{PING_MULTI, "ping_multi", "hits=4", 4, 0},
+	{PING_MULTI, "ping_multi", "hits=4 budget=4", 4, 4},
+	{PING_MULTI, "ping_multi", "hits=8", 8, 0},
+	{PING_MEDIAN, "ping_median", "it=5", 5, 0},
+#if ULTRAPING_TIMER_ENABLED == true
+	{PING_TIMER, "ping_timer", "-", 0, 0},
+	{PING_MULTI_TIMER, "ping_multi_timer", "hits=4", 4, 0},
+#endif
+};
+
+struct Result {
+	char scene[16], method[24], params[24];
+	unsigned int calls;
+	double latency_ms, latency_max_ms, busy_ms, delay_ms, isr_ms, triggers, rounds_per_hit, hit_rate, error_us;
+};
+
+unsigned int truth[32]; // Expected echo times in uS, ascending.
+unsigned int truths;
+unsigned int hit[MAXIMUM_HITS];
+volatile boolean timerDone;
+unsigned int timerHits;
+unsigned long long timerLast; // Last time the timer called, it stops calling when the ping times out.
+
+void build(const Scene &scene) { // Set up the sensor and compute the echos it should hear.
+	sensor.clear_reflectors();
+	truths = 0;
+	for (uint8_t r = 0; r < scene.reflectors; r++) {
+		sensor.add_reflector(scene.cm[r], scene.strength[r], scene.secondary[r]);
+		float amplitude = scene.strength[r];
+		for (uint8_t k = 1; k <= scene.secondary[r] + 1 && amplitude >= sensor.threshold; k++, amplitude *= sensor.attenuation) {
+			float us = k * UltraPingSim::cm_to_us(scene.cm[r]);
+			if (us > sensor.blanking && us < MAX_DISTANCE * ULTRAPING_US_ROUNDTRIP_LENGTH) truth[truths++] = us;
+		}
+	}
+	for (unsigned int i = 1; i < truths; i++) // Insertion sort.
+		for (unsigned int j = i; j > 0 && truth[j - 1] > truth[j]; j--) {
+			unsigned int t = truth[j]; truth[j] = truth[j - 1]; truth[j - 1] = t;
+		}
+}
+
+#if ULTRAPING_TIMER_ENABLED == true
+void echoCheck() {
+	timerLast = UltraPingSim::now_ns();
+	if (sonar.check_timer()) timerDone = true;
+}
+
+void multiCheck() {
+	if (sonar.check_multi_timer()) {
+		timerHits = sonar.ping_result;
+		timerDone = true;
+	}
+}
+#endif
+
+unsigned int call(const Run &run) { // One call, echos found in hit[], returns how many.
+	switch (run.method) {
+		case PING:
+			hit[0] = sonar.ping();
+			return hit[0] ? 1 : 0;
+		case PING_THRESHOLD:
+			hit[0] = sonar.ping_threshold(run.a);
+			return hit[0] ? 1 : 0;
+		case PING_MULTI:
+			sonar.set_round_budget(run.budget);
+			return sonar.ping_multi(hit, run.a);
+		case PING_MEDIAN:
+			hit[0] = sonar.ping_median(run.a);
+			return hit[0] ? 1 : 0;
+#if ULTRAPING_TIMER_ENABLED == true
+		case PING_TIMER:
+			timerLast = UltraPingSim::now_ns();
+			timerDone = false;
+			sonar.ping_timer(echoCheck);
+			while (!timerDone && UltraPingSim::now_ns() - timerLast < 1000000ULL) UltraPingSim::advance(10);
+			hit[0] = timerDone ? sonar.ping_result : ULTRAPING_NO_ECHO;
+			return hit[0] ? 1 : 0;
+		case PING_MULTI_TIMER:
+			timerDone = false;
+			timerHits = 0;
+			if (sonar.ping_multi_timer(hit, run.a, multiCheck))
+				while (!timerDone) UltraPingSim::advance(10);
+			return timerHits;
+#else
+		default:
+			break;
+#endif
+	}
+	return 0;
+}
+
+Result bench(const Scene &scene, const Run &run) {
+	Result r;
+	memset(&r, 0, sizeof(r));
+	strncpy(r.scene, scene.name, sizeof(r.scene) - 1);
+	strncpy(r.method, run.name, sizeof(r.method) - 1);
+	strncpy(r.params, run.params, sizeof(r.params) - 1);
+	build(scene);
+	unsigned int minimum = run.method == PING_THRESHOLD ? run.a * ULTRAPING_US_ROUNDTRIP_LENGTH : 0;
+	unsigned int first = 0; // First truth the method should find.
+	while (first < truths && truth[first] < minimum) first++;
+	unsigned int wanted = run.method == PING_MULTI || run.method == PING_MULTI_TIMER ? run.a : 1;
+	if (wanted > truths - first) wanted = truths - first;
+
+	unsigned long seed = 1;
+	unsigned long rounds = 0, hits = 0, found = 0, expected = 0, empty = 0;
+	double error = 0;
+	UltraPingSim::advance(40000);
+	UltraPingSim::reset_stats();
+	for (r.calls = 0; r.calls < CALLS; r.calls++) {
+		unsigned long long start = UltraPingSim::now_ns();
+		unsigned int n = call(run);
+		double ms = ((run.method == PING_TIMER && !timerDone ? timerLast : UltraPingSim::now_ns()) - start) / 1e6;
+		r.latency_ms += ms;
+		if (ms > r.latency_max_ms) r.latency_max_ms = ms;
+		if (run.method == PING_MULTI || run.method == PING_MULTI_TIMER) rounds += sonar.multi_rounds;
+		hits += n;
+		if (!truths || wanted == 0) {
+			if (n == 0) empty++;
+		} else {
+			expected += wanted;
+			for (unsigned int t = first; t < first + wanted; t++) // Closest hit to each truth.
+				for (unsigned int h = 0; h < n; h++) {
+					int e = abs((int) hit[h] - (int) truth[t]);
+					if (e <= TOLERANCE) {
+						found++;
+						error += e;
+						break;
+					}
+				}
+		}
+		seed = seed * 1103515245 + 12345; // Vary the phase between calls.
+		UltraPingSim::advance(30000 + (seed >> 16) % 1000);
+	}
+	r.latency_ms /= r.calls;
+	r.busy_ms = UltraPingSim::stats.busy_ns / 1e6 / r.calls;
+	r.delay_ms = UltraPingSim::stats.delay_ns / 1e6 / r.calls;
+	r.isr_ms = UltraPingSim::stats.isr_ns / 1e6 / r.calls;
+	r.triggers = (double) UltraPingSim::stats.triggers / r.calls;
+	r.rounds_per_hit = hits ? (double) rounds / hits : 0;
+	r.hit_rate = expected ? (double) found / expected : (double) empty / r.calls;
+	r.error_us = found ? error / found : 0;
+	return r;
+}
+
+void print(const Result &r) {
+	printf("%s,%s,%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f,%.1f\n", r.scene, r.method, r.params, r.calls,
+		r.latency_ms, r.latency_max_ms, r.busy_ms, r.delay_ms, r.isr_ms, r.triggers, r.rounds_per_hit, r.hit_rate, r.error_us);
+}
+
+boolean parse(const char *line, Result &r) {
+	memset(&r, 0, sizeof(r));
+	return sscanf(line, "%15[^,],%23[^,],%23[^,],%u,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf", r.scene, r.method, r.params, &r.calls,
+		&r.latency_ms, &r.latency_max_ms, &r.busy_ms, &r.delay_ms, &r.isr_ms, &r.triggers, &r.rounds_per_hit, &r.hit_rate, &r.error_us) == 13;
+}
+
+unsigned int regressions = 0;
+const char *deadCall; // Dead sensor call in progress, for the alarm.
+
+void deadAlarm(int) {
+	printf("REGRESSION dead,%s,max=%u: never returned\n", deadCall, ULTRAPING_MAX_SENSOR_DISTANCE);
+	fflush(stdout);
+	_exit(1);
+}
+
+void dead(const char *name, uint8_t pings) { // Check the dead sensor call just made.
+	double ms = (UltraPingSim::now_ns() - timerLast) / 1e6;
+	if (hit[0] != ULTRAPING_NO_ECHO) {
+		printf("REGRESSION dead,%s,max=%u: echo %u\n", name, ULTRAPING_MAX_SENSOR_DISTANCE, hit[0]);
+		regressions++;
+	} else if (ms > DEAD_LIMIT * pings) {
+		printf("REGRESSION dead,%s,max=%u: latency_ms %.3f\n", name, ULTRAPING_MAX_SENSOR_DISTANCE, ms);
+		regressions++;
+	}
+}
+
+void dead() { // Dead sensor at the longest max distance, every call must time out.
+	UltraPing sonar(DEAD_TRIGGER, DEAD_ECHO, ULTRAPING_MAX_SENSOR_DISTANCE);
+	signal(SIGALRM, deadAlarm);
+	alarm(10);
+	UltraPingSim::advance(40000);
+	deadCall = "ping";
+	timerLast = UltraPingSim::now_ns();
+	hit[0] = sonar.ping();
+	dead(deadCall, 1);
+	deadCall = "ping_median";
+	timerLast = UltraPingSim::now_ns();
+	hit[0] = sonar.ping_median(3);
+	dead(deadCall, 3 * 2); // Pings and the delays between them.
+	deadCall = "ping_multi";
+	timerLast = UltraPingSim::now_ns();
+	hit[0] = ULTRAPING_NO_ECHO;
+	sonar.ping_multi(hit, MAXIMUM_HITS);
+	dead(deadCall, 1);
+	alarm(0);
+}
+
+void regression(const Result &r, const char *column, double base, double now) {
+	printf("REGRESSION %s,%s,%s: %s %.3f -> %.3f\n", r.scene, r.method, r.params, column, base, now);
+	regressions++;
+}
+
+void compare(const Result &base, const Result &r) {
+	if (r.latency_ms > base.latency_ms * 1.05 + 0.01) regression(r, "latency_ms", base.latency_ms, r.latency_ms);
+	if (r.busy_ms + r.delay_ms > (base.busy_ms + base.delay_ms) * 1.05 + 0.01) regression(r, "busy_ms+delay_ms", base.busy_ms + base.delay_ms, r.busy_ms + r.delay_ms);
+	if (r.triggers > base.triggers * 1.05 + 0.01) regression(r, "triggers", base.triggers, r.triggers);
+	if (r.hit_rate < base.hit_rate - 0.01) regression(r, "hit_rate", base.hit_rate, r.hit_rate);
+	if (r.error_us > base.error_us + 5) regression(r, "error_us", base.error_us, r.error_us);
+}
+
+int main(int argc, char *argv[]) {
+	FILE *baseline = NULL;
+	if (argc > 1 && !(baseline = fopen(argv[1], "r"))) {
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 2;
+	}
+	Result base[sizeof(scenes) / sizeof(scenes[0]) * sizeof(runs) / sizeof(runs[0])];
+	unsigned int bases = 0;
+	char line[256];
+	while (baseline && fgets(line, sizeof(line), baseline))
+		if (bases < sizeof(base) / sizeof(base[0]) && parse(line, base[bases])) bases++;
+
+	if (!baseline) printf("scene,method,params,calls,latency_ms,latency_max_ms,busy_ms,delay_ms,isr_ms,triggers,rounds_per_hit,hit_rate,error_us\n");
+	for (unsigned int s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++)
+		for (unsigned int m = 0; m < sizeof(runs) / sizeof(runs[0]); m++) {
+			Result r = bench(scenes[s], runs[m]);
+			if (!baseline) {
+				print(r);
+				continue;
+			}
+			for (unsigned int b = 0; b < bases; b++)
+				if (!strcmp(base[b].scene, r.scene) && !strcmp(base[b].method, r.method) && !strcmp(base[b].params, r.params))
+					compare(base[b], r);
+		}
+	if (baseline) {
+		dead();
+		fclose(baseline);
+		printf("%u regressions\n", regressions);
+	}
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+// ---------------------------------------------------------------------------
+// Decoder for UltraPingFrame streams on the host.
+// Reads a captured serial stream (see the UltraPingMultiBinary example) from
+// stdin and prints one CSV line per valid frame:
+//   sensor, time_ms, count, hit_us...
+// The 16-bit timestamps are unwrapped per sensor, so time_ms keeps counting
+// past 65535 as long as a sensor sends at least one frame a minute.
+// Bytes outside frames and frames with a bad CRC are skipped and counted on
+// stderr.
+//
+// With --check it instead encodes random frames with noise between them and
+// feeds them through the decoder, once clean and once with a bit flipped in
+// every tenth frame. It exits with 1 if a damaged frame is accepted, if a clean
+// frame is lost or changed, or if damage costs more than the damaged frames
+// and about one frame in 25 damaged ones (a damaged length byte makes the
+// decoder wait for a longer frame, and the frames it swallowed come out late
+// or not at all).
+//
+// Build and run from the library folder:
+//   g++ -O2 -DULTRAPING_SIM -I. -Iextras/sim UltraPing.cpp UltraPingFrame.cpp extras/sim/UltraPingSim.cpp extras/sim/UltraPingFrameDump.cpp -o ultraping_frame_dump
+//   stty -F /dev/ttyACM0 115200 raw && ./ultraping_frame_dump < /dev/ttyACM0
+//   ./ultraping_frame_dump --check
+// ---------------------------------------------------------------------------
+#include <UltraPingFrame.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMES 20000
+
+struct sent {
+	uint8_t sensor, count;
+	unsigned long timestamp;
+	unsigned int hits[ULTRAPING_FRAME_MAX_HITS];
+	boolean corrupt, found;
+};
+
+int check(const char *name, int corruptEvery) {
+	static sent frame[FRAMES];
+	UltraPingFrameDecoder decoder;
+	uint8_t buffer[ULTRAPING_FRAME_SIZE(ULTRAPING_FRAME_MAX_HITS)];
+	unsigned long bytes = 0, lost = 0, late = 0, wrong = 0, corrupted = 0;
+	srand(1);
+	for (unsigned long f = 0; f < FRAMES; f++) {
+		sent &s = frame[f];
+		s.count = rand() % (ULTRAPING_FRAME_MAX_HITS + 1);
+		unsigned int echo = rand() % 2000;
+		for (uint8_t i = 0; i < s.count; i++) {
+			s.hits[i] = echo;
+			echo += rand() % 4 ? rand() % 300 : rand() % 3000; // Mostly close echos, sometimes a longer gap.
+		}
+		s.sensor = rand() % 8;
+		s.timestamp = f * 37;
+		s.found = false;
+		uint8_t length = UltraPingFrame::encode(buffer, s.sensor, s.timestamp, s.hits, s.count);
+		bytes += length;
+
+		s.corrupt = corruptEvery && rand() % corruptEvery == 0;
+		if (s.corrupt) {
+			buffer[rand() % length] ^= 1 << (rand() % 8);
+			corrupted++;
+		}
+		if (rand() % 10 == 0) decoder.feed(rand() % 256); // Noise between frames.
+
+		for (uint8_t i = 0; i < length; i++) {
+			if (!decoder.feed(buffer[i])) continue;
+			unsigned long g = f + 1, oldest = f > 64 ? f - 64 : 0;
+			while (g-- > oldest) { // A damaged length can hold back the frames after it, they come out late.
+				sent &t = frame[g];
+				if (!t.found && decoder.sensor == t.sensor && decoder.timestamp == (t.timestamp & 0xFFFF) && decoder.count == t.count && !memcmp(decoder.hits, t.hits, t.count * sizeof(t.hits[0]))) break;
+			}
+			if (g + 1 == oldest) wrong++;
+			else {
+				frame[g].found = true;
+				if (g != f) late++;
+			}
+		}
+	}
+	for (unsigned long f = 0; f < FRAMES; f++) if (!frame[f].corrupt && !frame[f].found) lost++;
+	printf("%s: frames: %lu, bytes/frame: %.1f, corrupted: %lu, intact lost: %lu, late: %lu, wrong accepted: %lu, errors: %lu\n",
+		name, (unsigned long) FRAMES, (double) bytes / FRAMES, corrupted, lost, late, wrong, decoder.errors);
+	if (!corruptEvery) return lost || late || wrong ? 1 : 0;
+	return wrong || lost * 25 > corrupted ? 1 : 0; // CRC-16 lets about 1 in 65536 damaged candidates through, a damaged length can swallow the next frame.
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && !strcmp(argv[1], "--check")) return check("clean", 0) | check("corrupted", 10);
+
+	UltraPingFrameDecoder decoder;
+	uint16_t last[256];
+	unsigned long base[256];
+	boolean seen[256] = {false};
+	unsigned long frames = 0;
+	int data;
+	printf("sensor,time_ms,count,hit_us\n");
+	while ((data = getchar()) != EOF) {
+		if (!decoder.feed(data)) continue;
+		uint8_t s = decoder.sensor;
+		if (!seen[s]) {
+			seen[s] = true;
+			base[s] = 0;
+		} else if (decoder.timestamp < last[s]) base[s] += 0x10000;
+		last[s] = decoder.timestamp;
+		printf("%u,%lu,%u", s, base[s] + decoder.timestamp, decoder.count);
+		for (uint8_t i = 0; i < decoder.count; i++) printf(",%u", decoder.hits[i]);
+		printf("\n");
+		frames++;
+	}
+	fprintf(stderr, "%lu frames, %lu errors\n", frames, decoder.errors);
+	return 0;
+}
@@ -0,0 +1,237 @@
+// ---------------------------------------------------------------------------
+// Replay of traces recorded with UltraPingTrace through the ping methods.
+// Reads traces as printed by trace.dump() from stdin (other lines, like the
+// sketch's own output, are skipped) and, for each trace, runs the recorded
+// ping, ping_median and ping_multi calls on a new UltraPing against a
+// simulated sensor in script mode: the Nth trigger of a call starts a ping
+// after the recorded start time and the echo ends after the recorded echo
+// time (corrected by how much shorter the library measures the simulated
+// sensor, found with one ping first). Round budget changes are applied, and
+// the time between calls is kept.
+//
+// With the library unchanged, every call returns what it did in the field
+// (within TOLERANCE). After a change to the measurement algorithms,
+// mismatches show which recorded scenes now give other results, and the
+// virtual latency and triggers show what the change costs. A changed
+// algorithm that triggers at other times still gets the recorded answer to
+// its Nth trigger, so a call is exact up to its first trigger that differs.
+// Timer methods and probes from set_multi_probes() are not replayed.
+//
+// One CSV line per trace:
+//   trace, calls, matched, triggers, recorded_triggers, latency_ms, busy_ms
+// and one line on stderr for each call that doesn't match. Exits with 1 if
+// any call doesn't match.
+//
+// With --record [traces] it instead records traces from simulated scenes
+// and dumps them, so the replay can be checked without hardware:
+//   ./ultraping_replay --record 20 | ./ultraping_replay
+//
+// Build and run from the library folder:
+//   g++ -O2 -DULTRAPING_SIM -DULTRAPING_TRACE_ENABLED=true -I. -Iextras/sim UltraPing.cpp UltraPingTrace.cpp extras/sim/UltraPingSim.cpp extras/sim/UltraPingReplay.cpp -o ultraping_replay
+//   ./ultraping_replay < capture.txt
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+#include <UltraPingTrace.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRIGGER_PIN  12
+#define ECHO_PIN     11
+#define MAX_EVENTS   65536
+#define MAX_HITS     32
+#define TOLERANCE    8 // uS between a replayed and a recorded echo time to match, plus 1/256 of the echo time (recorded times are whole uS, the multi search adds up the rounding over its rounds).
+
+UltraPingTraceEvent events[MAX_EVENTS];
+unsigned int eventCount;
+UltraPingSimStep steps[MAX_EVENTS];
+unsigned int stepCount;
+unsigned int stepAt[MAX_EVENTS]; // Steps before each event.
+
+int type_of(char letter) {
+	const char *p = strchr(ULTRAPING_TRACE_LETTERS, letter);
+	return letter && p ? p - ULTRAPING_TRACE_LETTERS : -1;
+}
+
+boolean read_trace() { // Next trace from stdin into events[], false at end of input.
+	char token[32];
+	eventCount = 0;
+	while (scanf("%31s", token) == 1) { // Find the start.
+		if (strcmp(token, "trace")) continue;
+		unsigned int count;
+		if (scanf("%u", &count) != 1) continue;
+		while (scanf("%31s", token) == 1 && strcmp(token, "end") && strcmp(token, "full")) {
+			int type = type_of(token[0]);
+			if (type < 0 || eventCount >= MAX_EVENTS) continue;
+			events[eventCount].type = type;
+			events[eventCount].value = strtoul(token + 1, NULL, 10);
+			eventCount++;
+		}
+		return true;
+	}
+	return false;
+}
+
+void build_steps(int startBias, int echoBias) { // How the sensor answered each trigger, recorded times corrected by the measuring bias.
+	stepCount = 0;
+	for (unsigned int i = 0; i < eventCount; i++) {
+		UltraPingSimStep *step = stepCount ? &steps[stepCount - 1] : NULL;
+		stepAt[i] = stepCount;
+		switch (events[i].type) {
+			case ULTRAPING_TRACE_ABORT: // Echo was still active at the trigger, keep it active until the library has seen it.
+				steps[stepCount].busy = true;
+				steps[stepCount].started = false;
+				steps[stepCount].start_us = 0;
+				steps[stepCount].heard = true;
+				steps[stepCount].echo_us = 100;
+				stepCount++;
+				break;
+			case ULTRAPING_TRACE_TRIGGER:
+				steps[stepCount].busy = false;
+				steps[stepCount].started = true;
+				steps[stepCount].start_us = 450;
+				steps[stepCount].heard = false;
+				steps[stepCount].echo_us = 0;
+				stepCount++;
+				break;
+			case ULTRAPING_TRACE_START:   if (step) step->start_us = events[i].value + startBias; break;
+			case ULTRAPING_TRACE_NO_START: if (step) step->started = false; break;
+			case ULTRAPING_TRACE_ECHO:
+				if (step) {
+					step->heard = true;
+					step->echo_us = events[i].value + echoBias;
+				}
+				break;
+		}
+	}
+}
+
+void calibrate(UltraPing &sonar, UltraPingSimSensor &sensor, int &startBias, int &echoBias) { // How much shorter the library measures a scripted start and echo.
+	UltraPingSimStep step = {false, true, 450, true, 1000};
+	UltraPingTrace<16> measured;
+	sensor.script(&step, 1);
+	sonar.set_trace(&measured);
+	sonar.ping();
+	sonar.set_trace(NULL);
+	startBias = echoBias = 0;
+	for (unsigned int i = 0; i < measured.count(); i++) {
+		if (measured.event(i).type == ULTRAPING_TRACE_START) startBias = (int) step.start_us - measured.event(i).value;
+		if (measured.event(i).type == ULTRAPING_TRACE_ECHO) echoBias = (int) step.echo_us - measured.event(i).value;
+	}
+}
+
+boolean near_enough(unsigned int a, unsigned int b) {
+	return (a > b ? a - b : b - a) <= TOLERANCE + b / 256;
+}
+
+int replay(unsigned int number) { // Replay events[], print the CSV line, returns number of mismatches.
+	unsigned int maxEcho = 0;
+	for (unsigned int i = 0; i < eventCount && !maxEcho; i++)
+		if (events[i].type == ULTRAPING_TRACE_MAX) maxEcho = events[i].value;
+	UltraPing sonar(TRIGGER_PIN, ECHO_PIN, maxEcho ? maxEcho / ULTRAPING_US_ROUNDTRIP_LENGTH - 1 : ULTRAPING_MAX_SENSOR_DISTANCE); // Max echo time is (max_distance + 1) round-trips, with the default speed of sound.
+	UltraPingSimSensor sensor(TRIGGER_PIN, ECHO_PIN);
+	int startBias, echoBias;
+	UltraPingSim::advance(40000);
+	calibrate(sonar, sensor, startBias, echoBias);
+	build_steps(startBias, echoBias);
+	UltraPingSim::advance(40000);
+	UltraPingSim::reset_stats();
+
+	unsigned int calls = 0, matched = 0, recordedTriggers = 0;
+	unsigned long long latency = 0;
+	unsigned int hit[MAX_HITS];
+	for (unsigned int i = 0; i < eventCount; i++) {
+		uint8_t type = events[i].type;
+		if (type == ULTRAPING_TRACE_TRIGGER) recordedTriggers++;
+		if (type == ULTRAPING_TRACE_BUDGET) sonar.set_round_budget(events[i].value);
+		if (type != ULTRAPING_TRACE_PING && type != ULTRAPING_TRACE_MEDIAN && type != ULTRAPING_TRACE_MULTI) continue;
+
+		unsigned int arg[3] = {events[i].value, 0, 0}, args = 1;
+		unsigned int j = i + 1;
+		for (; j < eventCount && events[j].type == ULTRAPING_TRACE_ARG; j++) if (args < 3) arg[args++] = events[j].value;
+		unsigned int gap = 0xFFFF, result = 0, hits = 0, recorded[MAX_HITS];
+		boolean complete = false;
+		for (; j < eventCount; j++) { // The call's events, up to its result and hits.
+			uint8_t t = events[j].type;
+			if (t == ULTRAPING_TRACE_PING || t == ULTRAPING_TRACE_MEDIAN || t == ULTRAPING_TRACE_MULTI) break;
+			if (t == ULTRAPING_TRACE_TRIGGER && gap == 0xFFFF && !complete) gap = events[j].value;
+			if (t == ULTRAPING_TRACE_RESULT) {
+				complete = true;
+				result = events[j].value;
+			}
+			if (t == ULTRAPING_TRACE_HIT && hits < MAX_HITS) recorded[hits++] = events[j].value;
+		}
+		if (!complete) break; // The trace filled up during this call.
+
+		unsigned long long now = UltraPingSim::now_ns();
+		unsigned long long due = gap == 0xFFFF ? now + 40000000ULL : sensor.last_trigger_ns + gap * 1000ULL;
+		if (due > now + 20000) UltraPingSim::advance_ns(due - now - 20000); // About the time from the call to its trigger.
+
+		sensor.script(&steps[stepAt[i]], stepCount - stepAt[i]); // Each call starts from its own recorded triggers.
+		now = UltraPingSim::now_ns();
+		unsigned int got = 0, n = 0;
+		boolean match;
+		if (type == ULTRAPING_TRACE_PING) {
+			got = sonar.ping(arg[0]);
+			match = near_enough(got, result);
+		} else if (type == ULTRAPING_TRACE_MEDIAN) {
+			got = sonar.ping_median(arg[0], arg[1]);
+			match = near_enough(got, result);
+		} else {
+			got = n = sonar.ping_multi(hit, min(arg[0], (unsigned int) MAX_HITS), arg[1], arg[2]);
+			match = n == result;
+			for (unsigned int h = 0; match && h < n && h < hits; h++) match = near_enough(hit[h], recorded[h]);
+		}
+		latency += UltraPingSim::now_ns() - now;
+		calls++;
+		if (match) {
+			matched++;
+			continue;
+		}
+		fprintf(stderr, "trace %u call %u %s(%u, %u, %u): recorded %u", number, calls, type == ULTRAPING_TRACE_PING ? "ping" : type == ULTRAPING_TRACE_MEDIAN ? "ping_median" : "ping_multi", arg[0], arg[1], arg[2], result);
+		for (unsigned int h = 0; h < hits; h++) fprintf(stderr, " %u", recorded[h]);
+		fprintf(stderr, ", replayed %u", got);
+		for (unsigned int h = 0; h < n; h++) fprintf(stderr, " %u", hit[h]);
+		fprintf(stderr, "\n");
+	}
+	printf("%u,%u,%u,%lu,%u,%.3f,%.3f\n", number, calls, matched, UltraPingSim::stats.triggers, recordedTriggers,
+		calls ? latency / 1e6 / calls : 0.0, calls ? (UltraPingSim::stats.busy_ns + UltraPingSim::stats.delay_ns) / 1e6 / calls : 0.0);
+	return calls - matched;
+}
+
+void record(unsigned int number, unsigned long &seed) { // Record a trace of random calls against a random scene.
+	UltraPing sonar(TRIGGER_PIN, ECHO_PIN, 200);
+	UltraPingSimSensor sensor(TRIGGER_PIN, ECHO_PIN);
+	UltraPingTrace<4096> trace;
+	unsigned int hit[8];
+	unsigned int reflectors = number % 4 + 1;
+	for (unsigned int r = 0; r < reflectors; r++) {
+		seed = seed * 1103515245 + 12345;
+		sensor.add_reflector(10 + (seed >> 8) % 180, 0.3 + (seed >> 16) % 70 / 100.0, (seed >> 4) % 3);
+	}
+	UltraPingSim::advance(40000);
+	sonar.set_trace(&trace);
+	for (unsigned int c = 0; c < 20; c++) {
+		seed = seed * 1103515245 + 12345;
+		switch ((seed >> 8) % 4) {
+			case 0: sonar.ping(); break;
+			case 1: sonar.ping_median(3); break;
+			case 2: sonar.set_round_budget((seed >> 12) % 2 ? 4 : 0); // Fall through.
+			default: sonar.ping_multi(hit, 8, (seed >> 16) % 2 ? 30 : 0); break;
+		}
+		UltraPingSim::advance((seed >> 4) % 40000);
+	}
+	trace.dump(Serial);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && !strcmp(argv[1], "--record")) {
+		unsigned long seed = 1;
+		unsigned int traces = argc > 2 ? atoi(argv[2]) : 10;
+		for (unsigned int t = 0; t < traces; t++) record(t, seed);
+		return 0;
+	}
+	int mismatches = 0;
+	printf("trace,calls,matched,triggers,recorded_triggers,latency_ms,busy_ms\n");
+	for (unsigned int t = 0; read_trace(); t++) mismatches += replay(t);
+	return mismatches ? 1 : 0;
+}
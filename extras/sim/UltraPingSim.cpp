@@ -0,0 +1,477 @@
+// ---------------------------------------------------------------------------
+// UltraPingSim, by Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+// ---------------------------------------------------------------------------
+// See "UltraPingSim.h" for purpose, sensor model and how to build.
+// ---------------------------------------------------------------------------
+
+#include <UltraPingSim.h>
+#include <stdio.h>
+
+#define SIM_NEVER 0xFFFFFFFFFFFFFFFFULL
+
+// Sensor states
+#define SIM_READY     0 // Waiting for a trigger.
+#define SIM_STARTING  1 // Triggered, burst not sent yet.
+#define SIM_LISTENING 2 // Echo pin active, waiting for an arrival.
+#define SIM_DEAD      3 // Echo ended, sensor restarting.
+
+
+// ---------------------------------------------------------------------------
+// Arduino compatible functions
+// ---------------------------------------------------------------------------
+
+unsigned long micros() {
+	UltraPingSim::stats.micros_calls++;
+	UltraPingSim::cpu(UltraPingSim::micros_cost_ns, false);
+	return UltraPingSim::now_ns() / 1000;
+}
+
+unsigned long millis() {
+	UltraPingSim::cpu(UltraPingSim::micros_cost_ns, false);
+	return UltraPingSim::now_ns() / 1000000;
+}
+
+void delay(unsigned long ms) {
+	UltraPingSim::cpu(ms * 1000000ULL, true);
+}
+
+void delayMicroseconds(unsigned int us) {
+	UltraPingSim::cpu(us * 1000ULL, true);
+}
+
+int digitalRead(uint8_t pin) {
+	UltraPingSim::stats.read_calls++;
+	UltraPingSim::cpu(UltraPingSim::read_cost_ns, false);
+	return UltraPingSim::read_pin(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	UltraPingSim::write_pin(pin, val);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+	UltraPingSim::mode_pin(pin, mode);
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {
+	UltraPingSim::attach_pin(interruptNum, userFunc, mode);
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+	UltraPingSim::attach_pin(interruptNum, NULL, 0);
+}
+
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+	for (size_t i = 0; i < size; i++) write(buffer[i]);
+	return size;
+}
+
+size_t Print::print(const char *s) {
+	size_t n = 0;
+	while (*s) n += write((uint8_t) *s++);
+	return n;
+}
+
+size_t Print::print(char c) {
+	return write((uint8_t) c);
+}
+
+size_t Print::print(int n) {
+	return print((long) n);
+}
+
+size_t Print::print(unsigned int n) {
+	return print((unsigned long) n);
+}
+
+size_t Print::print(long n) {
+	char buffer[24];
+	snprintf(buffer, sizeof(buffer), "%ld", n);
+	return print(buffer);
+}
+
+size_t Print::print(unsigned long n) {
+	char buffer[24];
+	snprintf(buffer, sizeof(buffer), "%lu", n);
+	return print(buffer);
+}
+
+size_t Print::println() {
+	return write('\n');
+}
+
+size_t Print::println(const char *s) {
+	return print(s) + println();
+}
+
+size_t UltraPingSimSerial::write(uint8_t c) {
+	return putchar(c) == EOF ? 0 : 1;
+}
+
+UltraPingSimSerial Serial;
+
+
+IntervalTimer::IntervalTimer() {
+	_funct = NULL;
+	_period = 0;
+	_next = 0;
+}
+
+IntervalTimer::~IntervalTimer() {
+	end();
+}
+
+bool IntervalTimer::begin(void (*funct)(), unsigned int microseconds) {
+	if (!microseconds) return false;
+	_funct = funct;
+	_period = microseconds * 1000ULL;
+	_next = UltraPingSim::now_ns() + _period;
+	UltraPingSim::add_timer(this);
+	return true;
+}
+
+void IntervalTimer::end() {
+	_period = 0;
+	UltraPingSim::remove_timer(this);
+}
+
+
+// ---------------------------------------------------------------------------
+// Simulated sensor
+// ---------------------------------------------------------------------------
+
+float UltraPingSimSensor::sound_speed = 343.0;
+
+UltraPingSimSensor::UltraPingSimSensor(uint8_t trigger_pin, uint8_t echo_pin) {
+	_triggerPin = trigger_pin;
+	_echoPin = echo_pin;
+	_reflectors = 0;
+	_crosses = 0;
+	_script = NULL;
+	_scriptSteps = 0;
+
+	start_latency = 450;
+	dead_time = 10;
+	blanking = 120;
+	timeout = 38000;
+	attenuation = 0.5;
+	threshold = 0.1;
+	active_low = false;
+
+	reset();
+	UltraPingSim::add_sensor(this);
+}
+
+UltraPingSimSensor::~UltraPingSimSensor() {
+	UltraPingSim::remove_sensor(this);
+}
+
+void UltraPingSimSensor::add_reflector(float distance_cm, float strength, uint8_t secondary) {
+	add_reflector_us(UltraPingSim::cm_to_us(distance_cm), strength, secondary);
+}
+
+void UltraPingSimSensor::add_reflector_us(float echo_us, float strength, uint8_t secondary) {
+	if (_reflectors >= ULTRAPING_SIM_MAX_REFLECTORS) return;
+	_reflector[_reflectors].echo_us = echo_us;
+	_reflector[_reflectors].strength = strength;
+	_reflector[_reflectors].secondary = secondary;
+	_reflectors++;
+}
+
+void UltraPingSimSensor::clear_reflectors() {
+	_reflectors = 0;
+	_crosses = 0;
+}
+
+void UltraPingSimSensor::hear(UltraPingSimSensor &other, float distance_cm, float strength) {
+	if (_crosses >= ULTRAPING_SIM_MAX_CROSS_TALK) return;
+	_cross[_crosses].other = &other;
+	_cross[_crosses].delay_us = UltraPingSim::cm_to_us(distance_cm) / 2;
+	_cross[_crosses].strength = strength;
+	_crosses++;
+}
+
+void UltraPingSimSensor::reset() {
+	_bursts = _burstNext = 0;
+	_state = SIM_READY;
+	_stateEnd = SIM_NEVER;
+	_triggerStart = 0;
+	triggers = ignored_triggers = 0;
+	last_trigger_ns = 0;
+	script_used = 0;
+}
+
+void UltraPingSimSensor::script(const UltraPingSimStep steps[], unsigned int count) {
+	_script = steps;
+	_scriptSteps = steps ? count : 0;
+	script_used = 0;
+}
+
+void UltraPingSimSensor::trigger_edge(boolean level, unsigned long long now) {
+	if (level) {
+		_triggerStart = now;
+		return;
+	}
+	update(now);
+	if ((_state != SIM_READY && !_script) || now - _triggerStart < 10000) { // Busy, or pulse shorter than 10uS. A script decides itself if a trigger starts.
+		ignored_triggers++;
+		return;
+	}
+	unsigned long long latency = start_latency * 1000ULL;
+	if (_script) { // Answer from the script.
+		UltraPingSimStep step = {false, true, start_latency, false, 0};
+		if (script_used < _scriptSteps) step = _script[script_used];
+		script_used++;
+		if (step.busy) { // Echo pin active at the trigger.
+			_state = SIM_LISTENING;
+			_stateEnd = now + step.echo_us * 1000ULL;
+		}
+		if (step.busy || !step.started) {
+			ignored_triggers++;
+			return;
+		}
+		latency = step.start_us * 1000ULL + 500; // Recorded times are whole uS, rounded down.
+		_scriptEcho = step.heard ? step.echo_us * 1000ULL + 500 : SIM_NEVER;
+	}
+	_state = SIM_STARTING;
+	_stateEnd = now + latency;
+	last_trigger_ns = now;
+	triggers++;
+	UltraPingSim::stats.triggers++;
+}
+
+void UltraPingSimSensor::update(unsigned long long now) {
+	while (_state != SIM_READY && _stateEnd <= now) {
+		switch (_state) {
+			case SIM_STARTING: // Send the burst, listen until first arrival from any burst still in the air.
+				_burst[_burstNext] = _stateEnd;
+				_burstNext = (_burstNext + 1) % ULTRAPING_SIM_MAX_BURSTS;
+				if (_bursts < ULTRAPING_SIM_MAX_BURSTS) _bursts++;
+				_state = SIM_LISTENING;
+				if (_script) _stateEnd += min(_scriptEcho, timeout * 1000ULL);
+				else _stateEnd = first_arrival(_stateEnd + blanking * 1000ULL, _stateEnd + timeout * 1000ULL);
+				break;
+			case SIM_LISTENING:
+				_state = SIM_DEAD;
+				_stateEnd += dead_time * 1000ULL;
+				break;
+			default:
+				_state = SIM_READY;
+				_stateEnd = SIM_NEVER;
+				break;
+		}
+	}
+}
+
+unsigned long long UltraPingSimSensor::next_event() const {
+	return _state == SIM_READY ? SIM_NEVER : _stateEnd;
+}
+
+boolean UltraPingSimSensor::echo_level(unsigned long long now) {
+	update(now);
+	return (_state == SIM_LISTENING) != active_low;
+}
+
+unsigned long long UltraPingSimSensor::first_arrival(unsigned long long from, unsigned long long until) const {
+	unsigned long long first = until;
+	for (uint8_t b = 0; b < _bursts; b++) {
+		for (uint8_t r = 0; r < _reflectors; r++) {
+			float amplitude = _reflector[r].strength;
+			for (uint8_t k = 1; k <= _reflector[r].secondary + 1 && amplitude >= threshold; k++) {
+				unsigned long long arrival = _burst[b] + (unsigned long long) (k * _reflector[r].echo_us * 1000.0);
+				if (arrival > from && arrival < first) first = arrival;
+				amplitude *= attenuation;
+			}
+		}
+	}
+	for (uint8_t c = 0; c < _crosses; c++) { // Bursts from other sensors.
+		const UltraPingSimSensor *other = _cross[c].other;
+		if (_cross[c].strength < threshold) continue;
+		for (uint8_t b = 0; b < other->_bursts; b++) {
+			unsigned long long arrival = other->_burst[b] + (unsigned long long) (_cross[c].delay_us * 1000.0);
+			if (arrival > from && arrival < first) first = arrival;
+		}
+	}
+	return first;
+}
+
+
+// ---------------------------------------------------------------------------
+// Virtual clock and pins
+// ---------------------------------------------------------------------------
+
+UltraPingSimStats UltraPingSim::stats;
+unsigned int UltraPingSim::micros_cost_ns = 1000;
+unsigned int UltraPingSim::read_cost_ns = 500;
+unsigned int UltraPingSim::isr_cost_ns = 3000;
+unsigned long long UltraPingSim::_now = 0;
+boolean UltraPingSim::_inIsr = false;
+UltraPingSimSensor *UltraPingSim::_sensor[ULTRAPING_SIM_MAX_SENSORS];
+IntervalTimer *UltraPingSim::_timer[ULTRAPING_SIM_MAX_TIMERS];
+uint8_t UltraPingSim::_pinLevel[ULTRAPING_SIM_MAX_PINS];
+uint8_t UltraPingSim::_pinMode[ULTRAPING_SIM_MAX_PINS];
+void (*UltraPingSim::_pinIsr[ULTRAPING_SIM_MAX_PINS])(void);
+uint8_t UltraPingSim::_pinIsrMode[ULTRAPING_SIM_MAX_PINS];
+uint8_t UltraPingSim::_pinIsrLevel[ULTRAPING_SIM_MAX_PINS];
+uint8_t UltraPingSim::_pinIsrs = 0;
+
+void UltraPingSim::reset() { // The clock is never reset, UltraPing objects may hold timestamps.
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++)
+		if (_timer[i]) _timer[i]->_period = 0;
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++) _timer[i] = NULL;
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_PINS; i++) _pinIsr[i] = NULL;
+	_pinIsrs = 0;
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++)
+		if (_sensor[i]) _sensor[i]->reset();
+	reset_stats();
+}
+
+void UltraPingSim::reset_stats() {
+	stats = UltraPingSimStats();
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++)
+		if (_sensor[i]) _sensor[i]->triggers = _sensor[i]->ignored_triggers = 0;
+}
+
+void UltraPingSim::advance(unsigned long us) {
+	advance_ns(us * 1000ULL);
+}
+
+void UltraPingSim::advance_ns(unsigned long long ns) {
+	unsigned long long start = _now, isr = stats.isr_ns;
+	run_until(_now + ns);
+	stats.idle_ns += (_now - start) - (stats.isr_ns - isr);
+}
+
+unsigned long long UltraPingSim::now_ns() {
+	return _now;
+}
+
+float UltraPingSim::cm_to_us(float distance_cm) {
+	return distance_cm * 20000.0 / UltraPingSimSensor::sound_speed;
+}
+
+uint16_t UltraPingSim::timer1() {
+	cpu(read_cost_ns, false);
+	return (uint16_t) (_now / 500);
+}
+
+void UltraPingSim::cpu(unsigned long long ns, boolean delaying) {
+	if (_inIsr) { // Interrupts are disabled inside an ISR, just let the time pass.
+		_now += ns;
+		return;
+	}
+	if (delaying) stats.delay_ns += ns;
+	else stats.busy_ns += ns;
+	run_until(_now + ns);
+}
+
+void UltraPingSim::run_until(unsigned long long t) { // Foreground runs until t, interrupts steal time on the way.
+	for (;;) {
+		IntervalTimer *timer = NULL;
+		unsigned long long next = t + 1;
+		for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++)
+			if (_timer[i] && _timer[i]->_period && _timer[i]->_next < next) {
+				timer = _timer[i];
+				next = timer->_next;
+			}
+		UltraPingSimSensor *sensor = NULL;
+		for (uint8_t i = 0; _pinIsrs && i < ULTRAPING_SIM_MAX_SENSORS; i++) {
+			UltraPingSimSensor *s = _sensor[i];
+			if (s && _pinIsr[s->_echoPin] && s->next_event() < next) {
+				sensor = s;
+				next = s->next_event();
+			}
+		}
+		if (next > t) break;
+		if (next > _now) _now = next;
+
+		if (sensor) { // Echo pin may change, fire pin change interrupt.
+			uint8_t pin = sensor->_echoPin;
+			sensor->update(_now);
+			if (_pinMode[pin] == OUTPUT) continue;
+			uint8_t level = sensor->echo_level(_now) ? HIGH : LOW;
+			if (level == _pinIsrLevel[pin]) continue;
+			_pinIsrLevel[pin] = level;
+			if (_pinIsrMode[pin] == CHANGE || (_pinIsrMode[pin] == RISING && level) || (_pinIsrMode[pin] == FALLING && !level))
+				interrupt(_pinIsr[pin], t);
+			continue;
+		}
+
+		timer->_next += timer->_period;
+		interrupt(timer->_funct, t);
+		if (timer->_period)
+			while (timer->_next <= _now) timer->_next += timer->_period; // Missed interrupts are collapsed into one.
+	}
+	if (t > _now) _now = t;
+}
+
+void UltraPingSim::interrupt(void (*userFunc)(void), unsigned long long &t) {
+	unsigned long long start = _now;
+	_inIsr = true;
+	_now += isr_cost_ns;
+	stats.isr_calls++;
+	userFunc();
+	_inIsr = false;
+	stats.isr_ns += _now - start;
+	t += _now - start; // Foreground work is delayed by the interrupt.
+}
+
+int UltraPingSim::read_pin(uint8_t pin) {
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++) {
+		UltraPingSimSensor *s = _sensor[i];
+		if (s && s->_echoPin == pin && _pinMode[pin] != OUTPUT) return s->echo_level(_now) ? HIGH : LOW;
+	}
+	return pin < ULTRAPING_SIM_MAX_PINS ? _pinLevel[pin] : LOW;
+}
+
+void UltraPingSim::write_pin(uint8_t pin, uint8_t val) {
+	if (pin >= ULTRAPING_SIM_MAX_PINS) return;
+	val = val ? HIGH : LOW;
+	if (_pinLevel[pin] == val) return;
+	_pinLevel[pin] = val;
+	if (_pinMode[pin] != OUTPUT) return; // Writing an input only changes the pull-up.
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++)
+		if (_sensor[i] && _sensor[i]->_triggerPin == pin) _sensor[i]->trigger_edge(val, _now);
+}
+
+void UltraPingSim::mode_pin(uint8_t pin, uint8_t mode) {
+	if (pin < ULTRAPING_SIM_MAX_PINS) _pinMode[pin] = mode;
+}
+
+void UltraPingSim::attach_pin(uint8_t pin, void (*userFunc)(void), int mode) {
+	if (pin >= ULTRAPING_SIM_MAX_PINS) return;
+	if (!_pinIsr[pin] != !userFunc) _pinIsrs += userFunc ? 1 : -1;
+	_pinIsrLevel[pin] = read_pin(pin);
+	_pinIsrMode[pin] = mode;
+	_pinIsr[pin] = userFunc;
+}
+
+void UltraPingSim::add_sensor(UltraPingSimSensor *sensor) {
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++)
+		if (!_sensor[i]) {
+			_sensor[i] = sensor;
+			return;
+		}
+}
+
+void UltraPingSim::remove_sensor(UltraPingSimSensor *sensor) {
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_SENSORS; i++)
+		if (_sensor[i] == sensor) _sensor[i] = NULL;
+}
+
+void UltraPingSim::add_timer(IntervalTimer *timer) {
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++)
+		if (_timer[i] == timer) return;
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++)
+		if (!_timer[i]) {
+			_timer[i] = timer;
+			return;
+		}
+}
+
+void UltraPingSim::remove_timer(IntervalTimer *timer) {
+	for (uint8_t i = 0; i < ULTRAPING_SIM_MAX_TIMERS; i++)
+		if (_timer[i] == timer) _timer[i] = NULL;
+}
@@ -0,0 +1,272 @@
+// ---------------------------------------------------------------------------
+// UltraPingSim - Host-side simulated hardware for UltraPing
+//
+// AUTHOR/LICENSE:
+// Lasse Löfquist - ultraping@tvartom.com
+// Copyright 2017 License: GNU GPL v3 http://www.gnu.org/licenses/gpl.html
+//
+// BACKGROUND:
+// UltraPing talks to the hardware through micros(), delay(),
+// delayMicroseconds(), digitalRead(), digitalWrite(), pinMode() and (for the
+// timer methods) an IntervalTimer. When UltraPing.h is compiled with
+// ULTRAPING_SIM defined, this header replaces Arduino.h and provides all of
+// them on top of a virtual clock and an acoustic scene, so the unmodified
+// library runs on Linux many times faster than real-time.
+//
+// The sensor model is HC-SR04-like:
+// * A trigger pulse (>= 10uS) starts the sensor. After start_latency uS the
+//   burst is sent and the echo pin goes active.
+// * The echo pin goes not active on the first arrival from ANY earlier burst
+//   (this is what makes ping_multi work), or after timeout uS.
+// * Arrivals within blanking uS after the burst are not heard (ring-down).
+// * After the echo pin goes not active the sensor ignores triggers during
+//   dead_time uS (restart time).
+// * Every reflector returns an echo, and optionally secondary echoes (sound
+//   bouncing between sensor and reflector) at multiples of its distance, each
+//   weaker by attenuation. Arrivals weaker than threshold are not heard.
+// * A sensor can hear the bursts of other sensors (cross-talk), see hear().
+// * Instead of the scene, a sensor can answer its triggers from a script of
+//   recorded start and echo times, see script() and UltraPingReplay.cpp.
+//
+// The CPU is modelled as well: every micros() and digitalRead() call costs
+// some virtual time, so busy-wait loops advance the clock. Timer and pin
+// change interrupts (attachInterrupt) fire at their virtual time. Time is
+// accounted as busy-wait, delay, interrupt or idle (advanced by the host
+// program), see UltraPingSimStats.
+//
+// BUILD:
+//   g++ -DULTRAPING_SIM -I. -Iextras/sim UltraPing.cpp extras/sim/UltraPingSim.cpp your_program.cpp
+// See UltraPingSimExample.cpp, UltraPingBench.cpp for a benchmark of all
+// ping methods with a baseline (UltraPingBench.csv) to compare against, and
+// UltraPingReplay.cpp to replay traces recorded with UltraPingTrace.
+// ---------------------------------------------------------------------------
+
+#ifndef UltraPingSim_h
+#define UltraPingSim_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+
+// ---------------------------------------------------------------------------
+// Arduino compatible environment
+// ---------------------------------------------------------------------------
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) < ULTRAPING_SIM_MAX_PINS ? (p) : NOT_AN_INTERRUPT)
+
+#ifndef min
+	#define min(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef max
+	#define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+void pinMode(uint8_t pin, uint8_t mode);
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode); // Pin change interrupt, interruptNum is the pin.
+void detachInterrupt(uint8_t interruptNum);
+
+class Print { // The part of Arduino's Print that the library uses.
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		size_t write(const uint8_t *buffer, size_t size);
+		size_t print(const char *s);
+		size_t print(char c);
+		size_t print(int n);
+		size_t print(unsigned int n);
+		size_t print(long n);
+		size_t print(unsigned long n);
+		size_t println();
+		size_t println(const char *s);
+};
+
+class UltraPingSimSerial : public Print { // Serial, writes to stdout.
+	public:
+		void begin(unsigned long baud) { (void) baud; }
+		size_t write(uint8_t c);
+		using Print::write;
+};
+
+extern UltraPingSimSerial Serial;
+
+class IntervalTimer { // Same interface as the Teensy 3.x IntervalTimer, fired by the virtual clock.
+	public:
+		IntervalTimer();
+		~IntervalTimer();
+		bool begin(void (*funct)(), unsigned int microseconds);
+		void end();
+	private:
+		friend class UltraPingSim;
+		void (*_funct)();
+		unsigned long long _period; // Nanoseconds, 0 when not running.
+		unsigned long long _next;   // Nanoseconds.
+};
+
+
+// ---------------------------------------------------------------------------
+// Simulated scene
+// ---------------------------------------------------------------------------
+
+#ifndef ULTRAPING_SIM_MAX_SENSORS
+	#define ULTRAPING_SIM_MAX_SENSORS 16   // Maximum number of simulated sensors.
+#endif
+#ifndef ULTRAPING_SIM_MAX_REFLECTORS
+	#define ULTRAPING_SIM_MAX_REFLECTORS 8 // Maximum number of reflectors per sensor.
+#endif
+#ifndef ULTRAPING_SIM_MAX_BURSTS
+	#define ULTRAPING_SIM_MAX_BURSTS 8     // Number of recent bursts per sensor that can still be heard.
+#endif
+#ifndef ULTRAPING_SIM_MAX_CROSS_TALK
+	#define ULTRAPING_SIM_MAX_CROSS_TALK 4 // Maximum number of other sensors a sensor can hear.
+#endif
+#define ULTRAPING_SIM_MAX_PINS 64
+#define ULTRAPING_SIM_MAX_TIMERS 4
+
+struct UltraPingSimStep {  // How the sensor answers one trigger in a script.
+	boolean busy;          // Echo is still active from before, for echo_us after the trigger, and the trigger is ignored.
+	boolean started;       // False if the ping never starts.
+	unsigned int start_us; // uS from trigger to burst (echo active).
+	boolean heard;         // False if nothing is heard, the echo stays active for timeout uS.
+	unsigned int echo_us;  // uS from burst to echo end.
+};
+
+struct UltraPingSimReflector {
+	float echo_us;     // Round-trip time for the (first) echo in uS.
+	float strength;    // Amplitude of the first echo, 1.0 is a good reflector.
+	uint8_t secondary; // Number of secondary echoes (at 2x, 3x... echo_us).
+};
+
+class UltraPingSimSensor;
+struct UltraPingSimCrossTalk {
+	const UltraPingSimSensor *other; // Sensor whose bursts are heard.
+	float delay_us;                  // Time from other's burst to arrival.
+	float strength;
+};
+
+class UltraPingSimSensor {
+	public:
+		UltraPingSimSensor(uint8_t trigger_pin, uint8_t echo_pin);
+		~UltraPingSimSensor();
+
+		void add_reflector(float distance_cm, float strength = 1.0, uint8_t secondary = 0);
+		void add_reflector_us(float echo_us, float strength = 1.0, uint8_t secondary = 0);
+		void clear_reflectors();
+		void hear(UltraPingSimSensor &other, float distance_cm, float strength = 1.0); // Cross-talk, this sensor hears other's bursts after traveling distance_cm (one way).
+		void reset(); // Forget earlier bursts and make the sensor ready.
+		void script(const UltraPingSimStep steps[], unsigned int count); // Answer the next count accepted triggers from steps instead of the scene (NULL to go back), triggers after the last step hear nothing.
+
+		// Sensor timing and acoustic parameters, defaults are HC-SR04-like.
+		unsigned int start_latency; // uS from trigger pulse to burst (echo goes active). Default=450
+		unsigned int dead_time;     // uS after echo end before a new trigger is accepted. Default=10
+		unsigned int blanking;      // uS after the burst where nothing can be heard. Default=120
+		unsigned long timeout;      // uS the echo stays active when nothing is heard. Default=38000
+		float attenuation;          // Amplitude factor for every extra bounce of a secondary echo. Default=0.5
+		float threshold;            // Weakest amplitude the sensor hears. Default=0.1
+		boolean active_low;         // Echo pin is active low (URM37 PWM mode). Default=false
+
+		// Ground truth and counters for this sensor.
+		unsigned long triggers;         // Trigger pulses that started a burst.
+		unsigned long ignored_triggers; // Trigger pulses ignored (sensor busy or too short pulse).
+		unsigned long long last_trigger_ns; // When the last accepted trigger pulse ended.
+		unsigned int script_used;       // Steps of the script used so far.
+
+		static float sound_speed; // Speed of sound in m/s used by add_reflector(). Default=343.0
+	private:
+		friend class UltraPingSim;
+		void trigger_edge(boolean level, unsigned long long now);
+		void update(unsigned long long now);
+		unsigned long long next_event() const;
+		boolean echo_level(unsigned long long now);
+		unsigned long long first_arrival(unsigned long long from, unsigned long long until) const;
+
+		uint8_t _triggerPin;
+		uint8_t _echoPin;
+		UltraPingSimReflector _reflector[ULTRAPING_SIM_MAX_REFLECTORS];
+		uint8_t _reflectors;
+		UltraPingSimCrossTalk _cross[ULTRAPING_SIM_MAX_CROSS_TALK];
+		uint8_t _crosses;
+		unsigned long long _burst[ULTRAPING_SIM_MAX_BURSTS]; // Nanoseconds, ring of recent bursts.
+		uint8_t _bursts;
+		uint8_t _burstNext;
+		uint8_t _state;
+		unsigned long long _stateEnd;     // Nanoseconds, when current state ends.
+		unsigned long long _triggerStart; // Nanoseconds, trigger pin went high.
+		const UltraPingSimStep *_script;
+		unsigned int _scriptSteps;
+		unsigned long long _scriptEcho;   // Nanoseconds from burst to echo end for the current step, SIM_NEVER if nothing is heard.
+};
+
+struct UltraPingSimStats {
+	unsigned long long busy_ns;  // Foreground CPU spent in micros()/digitalRead() (busy-wait loops).
+	unsigned long long delay_ns; // Foreground CPU spent in delay()/delayMicroseconds().
+	unsigned long long isr_ns;   // CPU spent in timer and pin change interrupts.
+	unsigned long long idle_ns;  // Time advanced by the host program (free for application work).
+	unsigned long micros_calls;
+	unsigned long read_calls;
+	unsigned long isr_calls;
+	unsigned long triggers;      // Sum of accepted triggers over all sensors.
+};
+
+class UltraPingSim {
+	public:
+		static void reset();                  // Reset statistics, timers and all sensors (the clock keeps running).
+		static void reset_stats();
+		static void advance(unsigned long us); // Let time pass (the host program is idle), timers fire.
+		static void advance_ns(unsigned long long ns);
+		static unsigned long long now_ns();
+		static float cm_to_us(float distance_cm); // Round-trip echo time for a distance, uses sound_speed.
+		static uint16_t timer1(); // Free running 16-bit counter at 2 ticks per uS, like Timer1 with prescaler 8 at 16MHz (for FAST_CLOCK). Costs read_cost_ns.
+
+		static UltraPingSimStats stats;
+		static unsigned int micros_cost_ns; // CPU cost of a micros() call. Default=1000
+		static unsigned int read_cost_ns;   // CPU cost of a digitalRead() call. Default=500
+		static unsigned int isr_cost_ns;    // CPU cost to enter and leave an interrupt. Default=3000
+
+		// Called by the Arduino compatible functions, not called directly.
+		static void cpu(unsigned long long ns, boolean delaying);
+		static int read_pin(uint8_t pin);
+		static void write_pin(uint8_t pin, uint8_t val);
+		static void mode_pin(uint8_t pin, uint8_t mode);
+		static void add_sensor(UltraPingSimSensor *sensor);
+		static void remove_sensor(UltraPingSimSensor *sensor);
+		static void add_timer(IntervalTimer *timer);
+		static void remove_timer(IntervalTimer *timer);
+		static void attach_pin(uint8_t pin, void (*userFunc)(void), int mode);
+	private:
+		static void run_until(unsigned long long t);
+		static void interrupt(void (*userFunc)(void), unsigned long long &t);
+		static unsigned long long _now;
+		static boolean _inIsr;
+		static UltraPingSimSensor *_sensor[ULTRAPING_SIM_MAX_SENSORS];
+		static IntervalTimer *_timer[ULTRAPING_SIM_MAX_TIMERS];
+		static uint8_t _pinLevel[ULTRAPING_SIM_MAX_PINS];
+		static uint8_t _pinMode[ULTRAPING_SIM_MAX_PINS];
+		static void (*_pinIsr[ULTRAPING_SIM_MAX_PINS])(void);
+		static uint8_t _pinIsrMode[ULTRAPING_SIM_MAX_PINS];
+		static uint8_t _pinIsrLevel[ULTRAPING_SIM_MAX_PINS];
+		static uint8_t _pinIsrs; // Number of pins with an attached interrupt.
+};
+
+
+#endif
@@ -0,0 +1,174 @@
+// ---------------------------------------------------------------------------
+// Example running UltraPing on Linux against the simulated sensor. Pings a
+// scene with three reflectors using ping, ping_median, ping_multi,
+// ping_timer, ping_multi_timer and ping_edge, and prints result, virtual latency and
+// triggers per call. ping_multi is also run with a set_yield function, which
+// shows how much of its latency the sketch gets back, and with set_multi_reuse.
+//
+// Build and run from the library folder:
+//   g++ -O2 -DULTRAPING_SIM -I. -Iextras/sim UltraPing.cpp extras/sim/UltraPingSim.cpp extras/sim/UltraPingSimExample.cpp -o ultraping_sim
+//   ./ultraping_sim
+// ---------------------------------------------------------------------------
+#include <UltraPing.h>
+#include <stdio.h>
+#include <time.h>
+
+#define TRIGGER_PIN  12
+#define ECHO_PIN     11
+#define MAX_DISTANCE 200
+#define CALLS        1000
+#define MAXIMUM_HITS 5
+
+UltraPing sonar(TRIGGER_PIN, ECHO_PIN, MAX_DISTANCE);
+UltraPingSimSensor sensor(TRIGGER_PIN, ECHO_PIN);
+
+unsigned long long callStart;
+unsigned long long latency;
+unsigned long result;
+unsigned long timerDone;
+unsigned long long yielded;
+
+void work() { // Sketch work given the waits of ping_multi, takes its whole budget.
+	UltraPingSim::advance(200);
+	yielded += 200000;
+}
+
+void report(const char *name, double wall) {
+	printf("%-12s result=%6lu  latency=%8.2f ms  busy=%8.2f ms  isr=%6.3f ms  triggers/call=%5.2f  %6.0fx real-time\n",
+		name, result,
+		latency / 1e6 / CALLS,
+		(UltraPingSim::stats.busy_ns + UltraPingSim::stats.delay_ns) / 1e6 / CALLS,
+		UltraPingSim::stats.isr_ns / 1e6 / CALLS,
+		(double) UltraPingSim::stats.triggers / CALLS,
+		latency / 1e9 / wall);
+}
+
+void begin() {
+	UltraPingSim::advance(30000); // Let earlier echoes ebb away.
+	UltraPingSim::reset_stats();
+	latency = 0;
+	callStart = UltraPingSim::now_ns();
+}
+
+void echoCheck() {
+	if (sonar.check_timer()) {
+		result = sonar.ping_result;
+		timerDone = true;
+	}
+}
+
+void multiCheck() {
+	if (sonar.check_multi_timer()) {
+		result = sonar.ping_result;
+		timerDone = true;
+	}
+}
+
+void edgeCheck() {
+	if (sonar.check_edge()) result = sonar.ping_result;
+	timerDone = true;
+}
+
+int main() {
+	sensor.add_reflector(40, 1.0, 1); // 40cm, with one secondary echo at 80cm.
+	sensor.add_reflector(110, 0.6);
+	sensor.add_reflector(170, 0.4);
+
+	clock_t wall;
+
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		result = sonar.ping();
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	report("ping", (double) (clock() - wall) / CLOCKS_PER_SEC);
+
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		result = sonar.ping_median();
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	report("ping_median", (double) (clock() - wall) / CLOCKS_PER_SEC);
+
+	unsigned int hit[MAXIMUM_HITS], hits = 0;
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		hits = sonar.ping_multi(hit, MAXIMUM_HITS);
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	result = hits;
+	report("ping_multi", (double) (clock() - wall) / CLOCKS_PER_SEC);
+	for (unsigned int i = 0; i < hits; i++) printf("  hit %u: %u uS (%u cm)\n", i, hit[i], UltraPing::convert_length(hit[i]));
+	printf("  rounds: %u (%.2f per hit)\n", sonar.multi_rounds, hits ? (double) sonar.multi_rounds / hits : 0.0);
+
+	UltraPing::set_yield(work, 200);
+	yielded = 0;
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		hits = sonar.ping_multi(hit, MAXIMUM_HITS);
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	UltraPing::set_yield(NULL, 0);
+	result = hits;
+	report("multi_yield", (double) (clock() - wall) / CLOCKS_PER_SEC);
+	printf("  yielded: %.2f ms per call\n", yielded / 1e6 / CALLS);
+
+	sonar.set_multi_reuse(4);
+	unsigned long rounds = 0;
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		hits = sonar.ping_multi(hit, MAXIMUM_HITS);
+		latency += UltraPingSim::now_ns() - t;
+		rounds += sonar.multi_rounds;
+		UltraPingSim::advance(29000);
+	}
+	sonar.set_multi_reuse(0);
+	result = hits;
+	report("multi_reuse", (double) (clock() - wall) / CLOCKS_PER_SEC);
+	printf("  rounds: %.2f per call, %.2f triggers saved per call (a round without reuse sends 2)\n", (double) rounds / CALLS, (2.0 * rounds - UltraPingSim::stats.triggers) / CALLS);
+
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		timerDone = false;
+		sonar.ping_timer(echoCheck);
+		while (!timerDone && UltraPingSim::now_ns() - t < 40000000ULL) UltraPingSim::advance(100);
+		latency += UltraPingSim::now_ns() - t;
+		UltraPing::timer_stop();
+		UltraPingSim::advance(29000);
+	}
+	report("ping_timer", (double) (clock() - wall) / CLOCKS_PER_SEC);
+
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		timerDone = false;
+		if (sonar.ping_multi_timer(hit, MAXIMUM_HITS, multiCheck))
+			while (!timerDone) UltraPingSim::advance(100);
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	report("multi_timer", (double) (clock() - wall) / CLOCKS_PER_SEC);
+
+	begin(); wall = clock();
+	for (int i = 0; i < CALLS; i++) {
+		unsigned long long t = UltraPingSim::now_ns();
+		timerDone = false;
+		if (sonar.ping_edge(edgeCheck))
+			while (!timerDone && !sonar.check_edge() && UltraPingSim::now_ns() - t < 40000000ULL) UltraPingSim::advance(100);
+		latency += UltraPingSim::now_ns() - t;
+		UltraPingSim::advance(29000);
+	}
+	report("ping_edge", (double) (clock() - wall) / CLOCKS_PER_SEC);
+
+	return 0;
+}